@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace metaball {
+namespace bench {
+
+/*! \brief Seed for all randomly generated scenes and sample points */
+inline constexpr uint32_t random_seed = 1234;
+
+/*! \brief Scene presets from README */
+inline const std::vector<std::pair<std::string, std::string>> scene_presets = {
+    {"smooth blobs",
+     "reset scene; reset camera; set integrator = stratified sampling = 4; "
+     "add scene = power decay = 16, 2"},
+    {"camo",
+     "reset scene; reset camera; set integrator = grid = 4; "
+     "add scene = power decay"},
+};
+
+/*! \brief Configs for each scene element type */
+inline const std::vector<std::string> element_configs = {
+    "radial",         "polynomial",          "sinusoid",
+    "multi sinusoid", "radial sinusoid",     "polar sinusoid",
+    "minus exp",      "power decay",         "power decay = 16, 2",
+    "moire",          "radial moire",        "polar moire",
+    "metaball = 1000, 0.3",
+};
+
+/*! \brief Time a function
+ *
+ * The function is repeated until the total run time reaches a
+ * minimum duration.
+ *
+ * \return Seconds per function call
+ */
+template <typename Func>
+double measure_seconds(Func&& func, double min_seconds);
+
+}  // namespace bench
+}  // namespace metaball
+
+// Implementation
+#include "metaball/impl/bench.hpp"
@@ -26,12 +26,27 @@ class Camera {
   ScalarType focal_length() const;
   ScalarType film_speed() const;
 
+  /*! \brief Maximum width of froxels near the aperture
+   *
+   * Opt-in, zero by default. With deterministic integrators, every
+   * ray samples the same depths, and near the aperture the samples
+   * of neighboring pixels nearly coincide. Each sample depth is then
+   * covered by a screen-space grid of froxels, i.e. screen tiles of
+   * one depth slice, as many pixels wide as fit within froxel_width
+   * at that depth, up to max_froxel_size. Densities are only sampled
+   * by rays through froxel corners and are interpolated bilinearly
+   * in between. Depths where a pixel is wider than half of
+   * froxel_width are sampled by every ray.
+   */
+  ScalarType froxel_width() const;
+
   void set_aperture_position(const VectorType& position);
   void set_aperture_orientation(const VectorType& orientation);
   void set_row_orientation(const VectorType& orientation);
   void set_column_orientation(const VectorType& orientation);
   void set_focal_length(const ScalarType& focal_length);
   void set_film_speed(const ScalarType& film_speed);
+  void set_froxel_width(const ScalarType& width);
 
   void set_orientation(const VectorType& aperture_orientation,
                        const VectorType& row_orientation,
@@ -53,9 +68,21 @@ class Camera {
 
   ScalarType focal_length_ = 1;
   ScalarType film_speed_ = 1;
+  ScalarType froxel_width_ = 0;
+
+  /*! \brief Maximum number of pixels across a froxel */
+  static constexpr size_t max_froxel_size = 16;
 
   std::array<VectorType, 3> corner_pixel_and_offsets(size_t height,
                                                      size_t width) const;
+
+  /*! \brief Render image, sharing samples between rays with froxels
+   *
+   * See froxel_width.
+   */
+  Image make_froxel_image(const Scene& scene,
+                          const Scene::IntegrationPlan& plan, size_t height,
+                          size_t width) const;
 };
 
 }  // namespace metaball
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "metaball/camera.hpp"
+#include "metaball/integrator.hpp"
+#include "metaball/scene.hpp"
+
+namespace metaball {
+
+/*! \brief Split command line into command names and parameters
+ *
+ * Commands are separated by ";" and have the form "name = params".
+ */
+std::vector<std::pair<std::string_view, std::string_view>> parse_commands(
+    const std::string_view& line);
+
+/*! \brief Apply a scene, integrator, or camera command
+ *
+ * These commands don't depend on a display, so they are shared by
+ * the interactive application and the offline renderer.
+ *
+ * \return Whether the command was recognized.
+ */
+bool run_render_command(const std::string_view& name,
+                        const std::string_view& params, Scene& scene,
+                        std::unique_ptr<Integrator>& integrator,
+                        Camera& camera);
+
+/*! \brief Apply a line of scene, integrator, and camera commands
+ *
+ * Throws an exception if a command is not recognized.
+ */
+void run_render_commands(const std::string_view& line, Scene& scene,
+                         std::unique_ptr<Integrator>& integrator,
+                         Camera& camera);
+
+}  // namespace metaball
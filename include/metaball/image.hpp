@@ -1,6 +1,8 @@
 #pragma once
 
-#include <QImage>
+#include <array>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
 namespace metaball {
@@ -18,10 +20,14 @@ class Image {
   void set(size_t i, size_t j, DataType val);
   std::array<DataType, 3> get(size_t i, size_t j) const;
 
-  operator QImage() const;
+  /*! \brief Get pixel quantized to 8-bit RGB */
+  std::array<uint8_t, 3> get_8bit(size_t i, size_t j) const;
 
   void normalize();
 
+  /*! \brief Write to binary PPM file */
+  void save_ppm(const std::string_view& file) const;
+
  private:
   std::vector<DataType> data_;
   size_t height_, width_;
@@ -0,0 +1,24 @@
+#include <chrono>
+#include <cstddef>
+
+namespace metaball {
+namespace bench {
+
+template <typename Func>
+inline double measure_seconds(Func&& func, double min_seconds) {
+  func();  // Warmup
+  for (size_t iters = 1;; iters *= 2) {
+    const auto start_time = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; ++i) {
+      func();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start_time;
+    if (elapsed.count() >= min_seconds) {
+      return elapsed.count() / iters;
+    }
+  }
+}
+
+}  // namespace bench
+}  // namespace metaball
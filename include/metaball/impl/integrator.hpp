@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "metaball/random.hpp"
+#include "util/error.hpp"
+
+namespace metaball {
+
+namespace impl {
+namespace integrator {
+
+/*! \brief Gauss-Kronrod 7-15 nodes on [-1,1]
+ *
+ * Only non-negative nodes are listed, in decreasing order. Nodes
+ * with odd index are shared with the Gauss rule.
+ */
+inline constexpr std::array<double, 8> gauss_kronrod_nodes = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000};
+/*! \brief Kronrod 15-point weights */
+inline constexpr std::array<double, 8> kronrod_weights = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+/*! \brief Gauss 7-point weights */
+inline constexpr std::array<double, 4> gauss_weights = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+/*! \brief Thread-local buffers for sample points, weights, and values */
+struct SampleBuffers {
+  std::vector<Integrator::ScalarType> points;
+  std::vector<Integrator::ScalarType> weights;
+  std::vector<Integrator::ScalarType> values;
+};
+
+inline SampleBuffers& sample_buffers() {
+  thread_local SampleBuffers buffers;
+  return buffers;
+}
+
+/*! \brief Weighted sum of integrand at points
+ *
+ * Batch integrands are evaluated at all points in one call.
+ */
+template <typename Func>
+Integrator::ScalarType weighted_sum(
+    Func&& integrand, std::span<const Integrator::ScalarType> points,
+    std::span<const Integrator::ScalarType> weights) {
+  using ScalarType = Integrator::ScalarType;
+  ScalarType result = 0;
+  if constexpr (BatchIntegrand<std::remove_cvref_t<Func>, ScalarType>) {
+    auto& values = sample_buffers().values;
+    values.resize(points.size());
+    integrand.evaluate(points, values);
+    for (size_t i = 0; i < points.size(); ++i) {
+      result += weights[i] * values[i];
+    }
+  } else {
+    for (size_t i = 0; i < points.size(); ++i) {
+      result += weights[i] * integrand(points[i]);
+    }
+  }
+  return result;
+}
+
+/*! \brief Stochastic estimate of integral over unit interval
+ *
+ * Uniform samples are drawn in num_strata equal strata, with
+ * samples_per_stratum samples in each, and mapped to the unit
+ * interval with sample_map. The map returns a point and its
+ * probability density.
+ */
+template <typename Func, typename Map>
+Integrator::ScalarType sample_integral(
+    Func&& integrand, Map&& sample_map, size_t num_strata,
+    size_t samples_per_stratum,
+    Integrator::VarianceReduction variance_reduction) {
+  using ScalarType = Integrator::ScalarType;
+  using VarianceReduction = Integrator::VarianceReduction;
+  constexpr bool has_surrogate =
+      IntegrandWithSurrogate<std::remove_cvref_t<Func>, ScalarType>;
+  const bool antithetic = variance_reduction == VarianceReduction::Antithetic;
+  const bool control_variate =
+      has_surrogate && variance_reduction == VarianceReduction::ControlVariate;
+  const size_t num_samples = num_strata * samples_per_stratum;
+  const ScalarType stratum_size = static_cast<ScalarType>(1) / num_strata;
+
+  // Uniform samples
+  // Note: With antithetic sampling, sample num_samples-1-i is the
+  // reflection of sample i. It is in the reflected stratum, so
+  // stratification is preserved.
+  auto& buffers = sample_buffers();
+  auto& points = buffers.points;
+  points.resize(num_samples);
+  const size_t num_random_samples =
+      antithetic ? (num_samples + 1) / 2 : num_samples;
+  for (size_t i = 0; i < num_random_samples; ++i) {
+    const auto stratum = i / samples_per_stratum;
+    points[i] = stratum_size * (stratum + random::rand<ScalarType>());
+    if (antithetic && num_samples - 1 - i != i) {
+      points[num_samples - 1 - i] = 1 - points[i];
+    }
+  }
+
+  // Integrand divided by sample density, minus surrogate if using
+  // control variate
+  ScalarType result = 0;
+  if constexpr (has_surrogate) {
+    if (control_variate) {
+      for (const auto& u : points) {
+        const auto [t, pdf] = sample_map(u);
+        if (pdf > 0) {
+          const auto [value, surrogate] = integrand.with_surrogate(t);
+          result += (value - surrogate) / pdf;
+        }
+      }
+      result /= num_samples;
+    }
+  }
+  if (!control_variate) {
+    auto& weights = buffers.weights;
+    weights.resize(num_samples);
+    for (size_t i = 0; i < num_samples; ++i) {
+      const auto [t, pdf] = sample_map(points[i]);
+      const bool valid = pdf > 0;
+      points[i] = valid ? t : 0;
+      weights[i] = valid ? 1 / (pdf * num_samples) : 0;
+    }
+    result = weighted_sum(integrand, points, weights);
+  }
+
+  // Integrate surrogate with midpoint rule
+  if constexpr (has_surrogate) {
+    if (control_variate) {
+      const ScalarType grid_size = static_cast<ScalarType>(1) / num_samples;
+      ScalarType surrogate_integral = 0;
+      for (size_t i = 0; i < num_samples; ++i) {
+        const auto [t, pdf] = sample_map(grid_size * (i + 0.5));
+        if (pdf > 0) {
+          surrogate_integral += integrand.surrogate(t) / pdf;
+        }
+      }
+      result += grid_size * surrogate_integral;
+    }
+  }
+
+  return result;
+}
+
+/*! \brief Level function and its derivative at a point */
+struct LevelSample {
+  Integrator::ScalarType t;
+  Integrator::ScalarType value;
+  Integrator::ScalarType derivative;
+
+  /*! \brief Whether point is in level set */
+  bool inside() const { return value >= 0; }
+
+  /*! \brief Zero of tangent line */
+  Integrator::ScalarType tangent_zero() const {
+    return t - value / derivative;
+  }
+};
+
+/*! \brief Point where level function crosses zero
+ *
+ * The level function must have opposite signs at the ends of the
+ * interval. Newton steps are taken from the end with the smaller
+ * level, and replaced with bisection if they leave the bracket or do
+ * not halve the step size. Stops once the step or the bracket is
+ * within tolerance, or after max_iters evaluations.
+ */
+template <typename Level>
+Integrator::ScalarType find_crossing(Level&& level, const LevelSample& a,
+                                     const LevelSample& b,
+                                     Integrator::ScalarType tolerance,
+                                     size_t max_iters, size_t& num_evals) {
+  using ScalarType = Integrator::ScalarType;
+  auto x = std::abs(a.value) < std::abs(b.value) ? a : b;
+  ScalarType outside = a.inside() ? b.t : a.t;
+  ScalarType inside = a.inside() ? a.t : b.t;
+  ScalarType step = std::abs(b.t - a.t);
+  ScalarType prev_step = step;
+  for (size_t iter = 0;; ++iter) {
+    // Note: Comparisons are false if the Newton step is NaN.
+    const auto newton = x.tangent_zero();
+    const bool in_bracket = (newton - outside) * (newton - inside) < 0;
+    const bool converging =
+        std::abs(2 * x.value) < prev_step * std::abs(x.derivative);
+    const auto next =
+        in_bracket && converging ? newton : (outside + inside) / 2;
+    prev_step = step;
+    step = std::abs(next - x.t);
+    if (step <= tolerance || std::abs(inside - outside) <= tolerance ||
+        iter >= max_iters) {
+      return next;
+    }
+    const auto [value, derivative] = level(next);
+    ++num_evals;
+    x = {next, value, derivative};
+    (x.inside() ? inside : outside) = next;
+  }
+}
+
+/*! \brief Sample map for uniform sampling */
+inline std::pair<Integrator::ScalarType, Integrator::ScalarType> uniform_sample(
+    const Integrator::ScalarType& u) {
+  return {u, 1};
+}
+
+}  // namespace integrator
+}  // namespace impl
+
+template <typename Func>
+inline Integrator::ScalarType Integrator::operator()(Func&& integrand) const {
+  return visit([&integrand](const auto& integrator) -> ScalarType {
+    return integrator.integrate(integrand);
+  });
+}
+
+template <typename Visitor>
+inline decltype(auto) Integrator::visit(Visitor&& visitor) const {
+  switch (type_) {
+    case Type::Grid:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const GridIntegrator&>(*this));
+    case Type::Trapezoid:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const TrapezoidIntegrator&>(*this));
+    case Type::MonteCarlo:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const MonteCarloIntegrator&>(*this));
+    case Type::StratifiedSampling:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const StratifiedSamplingIntegrator&>(*this));
+    case Type::GaussLaguerre:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const GaussLaguerreIntegrator&>(*this));
+    case Type::ClenshawCurtis:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const ClenshawCurtisIntegrator&>(*this));
+    case Type::ImportanceSampling:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const ImportanceSamplingIntegrator&>(*this));
+    case Type::QuasiMonteCarlo:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const QuasiMonteCarloIntegrator&>(*this));
+    case Type::Adaptive:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const AdaptiveIntegrator&>(*this));
+    case Type::Crossing:
+      return std::forward<Visitor>(visitor)(
+          static_cast<const CrossingIntegrator&>(*this));
+  }
+  UTIL_ERROR("Unrecognized integrator type (", static_cast<int>(type_), ")");
+}
+
+template <typename Func>
+inline GridIntegrator::ScalarType GridIntegrator::integrate(
+    Func&& integrand) const {
+  const ScalarType half_grid_size = static_cast<ScalarType>(0.5) / num_evals_;
+  ScalarType result = 0;
+  for (size_t i = 0; i < num_evals_; ++i) {
+    result += integrand(half_grid_size * (2 * i + 1));
+  }
+  result *= 2 * half_grid_size;
+  return result;
+}
+
+template <typename Func>
+inline TrapezoidIntegrator::ScalarType TrapezoidIntegrator::integrate(
+    Func&& integrand) const {
+  constexpr ScalarType zero = static_cast<ScalarType>(0);
+  constexpr ScalarType one = static_cast<ScalarType>(1);
+  const ScalarType grid_size = one / (num_evals_ - 1);
+  ScalarType result = integrand(zero) / 2;
+  for (size_t i = 1; i < num_evals_ - 1; ++i) {
+    result += integrand(grid_size * i);
+  }
+  result += integrand(one) / 2;
+  result *= grid_size;
+  return result;
+}
+
+template <typename Func>
+inline MonteCarloIntegrator::ScalarType MonteCarloIntegrator::integrate(
+    Func&& integrand) const {
+  return impl::integrator::sample_integral(
+      std::forward<Func>(integrand), impl::integrator::uniform_sample, 1,
+      num_evals_, variance_reduction_);
+}
+
+template <typename Func>
+inline StratifiedSamplingIntegrator::ScalarType
+StratifiedSamplingIntegrator::integrate(Func&& integrand) const {
+  return impl::integrator::sample_integral(
+      std::forward<Func>(integrand), impl::integrator::uniform_sample,
+      num_grids_, evals_per_grid_, variance_reduction_);
+}
+
+template <typename Func>
+inline GaussLaguerreIntegrator::ScalarType GaussLaguerreIntegrator::integrate(
+    Func&& integrand) const {
+  ScalarType result = 0;
+  for (size_t i = 0; i < rule_.nodes.size(); ++i) {
+    result += rule_.weights[i] * integrand(rule_.nodes[i]);
+  }
+  return result;
+}
+
+template <typename Func>
+inline ClenshawCurtisIntegrator::ScalarType ClenshawCurtisIntegrator::integrate(
+    Func&& integrand) const {
+  ScalarType result = 0;
+  for (size_t i = 0; i < rule_.nodes.size(); ++i) {
+    result += rule_.weights[i] * integrand(rule_.nodes[i]);
+  }
+  return result;
+}
+
+template <typename Func>
+inline ImportanceSamplingIntegrator::ScalarType
+ImportanceSamplingIntegrator::integrate(Func&& integrand) const {
+  return impl::integrator::sample_integral(std::forward<Func>(integrand),
+                                           sample, num_evals_, 1,
+                                           variance_reduction_);
+}
+
+template <typename Func>
+inline QuasiMonteCarloIntegrator::ScalarType
+QuasiMonteCarloIntegrator::integrate(Func&& integrand) const {
+  // Rotating the lattice by a random amount modulo 1 is equivalent
+  // to shifting it by a random amount within one lattice spacing
+  const ScalarType grid_size = static_cast<ScalarType>(1) / num_evals_;
+  const ScalarType shift = grid_size * random::rand<ScalarType>();
+  auto& buffers = impl::integrator::sample_buffers();
+  buffers.points.resize(num_evals_);
+  buffers.weights.resize(num_evals_);
+  for (size_t i = 0; i < num_evals_; ++i) {
+    const auto [t, pdf] =
+        ImportanceSamplingIntegrator::sample(shift + grid_size * i);
+    const bool valid = pdf > 0;
+    buffers.points[i] = valid ? t : 0;
+    buffers.weights[i] = valid ? grid_size / pdf : 0;
+  }
+  return impl::integrator::weighted_sum(std::forward<Func>(integrand),
+                                        buffers.points, buffers.weights);
+}
+
+template <typename Func>
+inline AdaptiveIntegrator::ScalarType AdaptiveIntegrator::integrate(
+    Func&& integrand) const {
+  using namespace impl::integrator;
+  struct Interval {
+    ScalarType lower, upper, value, error;
+    bool operator<(const Interval& other) const { return error < other.error; }
+  };
+  size_t num_evals = 0;
+
+  // Integrand after change of variables to ray kernel CDF
+  auto integrand_cdf = [&](const ScalarType& u) -> ScalarType {
+    const auto [t, pdf] = ImportanceSamplingIntegrator::sample(u);
+    return pdf > 0 ? integrand(t) / pdf : 0;
+  };
+
+  // Apply Gauss-Kronrod rule to interval
+  auto make_interval = [&](ScalarType lower, ScalarType upper) -> Interval {
+    const auto center = (lower + upper) / 2;
+    const auto half_length = (upper - lower) / 2;
+    const auto center_val = integrand_cdf(center);
+    ScalarType kronrod = kronrod_weights[7] * center_val;
+    ScalarType gauss = gauss_weights[3] * center_val;
+    for (size_t j = 0; j < 7; ++j) {
+      const auto offset = half_length * gauss_kronrod_nodes[j];
+      const auto vals =
+          integrand_cdf(center - offset) + integrand_cdf(center + offset);
+      kronrod += kronrod_weights[j] * vals;
+      if (j % 2 == 1) {
+        gauss += gauss_weights[j / 2] * vals;
+      }
+    }
+    num_evals += 15;
+    return {lower, upper, half_length * kronrod,
+            half_length * std::abs(kronrod - gauss)};
+  };
+
+  // Initial intervals have equal kernel mass
+  std::vector<Interval> intervals;
+  const auto initial_length = tail_cutoff_ / num_initial_intervals_;
+  for (size_t i = 0; i < num_initial_intervals_; ++i) {
+    intervals.push_back(
+        make_interval(initial_length * i, initial_length * (i + 1)));
+  }
+  std::make_heap(intervals.begin(), intervals.end());
+  ScalarType result = 0, error = tail_bound_;
+  for (const auto& interval : intervals) {
+    result += interval.value;
+    error += interval.error;
+  }
+
+  // Bisect interval with largest error until converged
+  while (error > std::max(abs_tol_, rel_tol_ * std::abs(result)) &&
+         num_evals + 30 <= max_evals_) {
+    std::pop_heap(intervals.begin(), intervals.end());
+    const auto worst = intervals.back();
+    intervals.pop_back();
+    const auto center = (worst.lower + worst.upper) / 2;
+    for (const auto& interval : {make_interval(worst.lower, center),
+                                 make_interval(center, worst.upper)}) {
+      result += interval.value;
+      error += interval.error;
+      intervals.push_back(interval);
+      std::push_heap(intervals.begin(), intervals.end());
+    }
+    result -= worst.value;
+    error -= worst.error;
+  }
+
+  num_evals_.fetch_add(num_evals, std::memory_order_relaxed);
+  return result;
+}
+
+template <typename Func>
+inline CrossingIntegrator::ScalarType CrossingIntegrator::integrate(
+    Func&& integrand) const {
+  if constexpr (IntegrandWithLevelSet<std::remove_cvref_t<Func>,
+                                      ScalarType>) {
+    if (integrand.has_level_set()) {
+      return integrate_level_set(integrand);
+    }
+  }
+
+  // Importance sampling with one sample per bracket if integrand has
+  // no level set
+  num_evals_.fetch_add(num_brackets_, std::memory_order_relaxed);
+  return impl::integrator::sample_integral(
+      std::forward<Func>(integrand), ImportanceSamplingIntegrator::sample,
+      num_brackets_, 1, VarianceReduction::None);
+}
+
+template <typename Func>
+inline CrossingIntegrator::ScalarType CrossingIntegrator::integrate_level_set(
+    const Func& integrand) const {
+  using namespace impl::integrator;
+  size_t num_evals = 0;
+  auto level = [&](const ScalarType& t) { return integrand.level(t); };
+  auto sample = [&](const ScalarType& t) -> LevelSample {
+    const auto [value, derivative] = level(t);
+    ++num_evals;
+    return {t, value, derivative};
+  };
+
+  // Integrate each bracket
+  // Note: Intervals are bisected depth-first, so the stack holds at
+  // most one pending interval per level of bisection.
+  struct Interval {
+    LevelSample lower, upper;
+    size_t depth;
+  };
+  std::array<Interval, max_subdivisions + 1> stack;
+  ScalarType result = 0;
+  auto lower = sample(bracket_edges_[0]);
+  for (size_t i = 0; i < num_brackets_; ++i) {
+    const auto upper = sample(bracket_edges_[i + 1]);
+    size_t stack_size = 0;
+    stack[stack_size++] = {lower, upper, 0};
+    while (stack_size > 0) {
+      const auto [a, b, depth] = stack[--stack_size];
+      if (a.inside() != b.inside()) {
+        const auto crossing = find_crossing(level, a, b, tolerance_,
+                                            max_newton_iters, num_evals);
+        result += a.inside() ? integrand.weight_integral(a.t, crossing)
+                             : integrand.weight_integral(crossing, b.t);
+        continue;
+      }
+      const auto a_zero = a.tangent_zero();
+      const auto b_zero = b.tangent_zero();
+      const bool may_cross =
+          a.t < a_zero && a_zero < b.t && a.t < b_zero && b_zero < b.t;
+      if (may_cross && depth < max_subdivisions) {
+        const auto center = sample((a.t + b.t) / 2);
+        stack[stack_size++] = {center, b, depth + 1};
+        stack[stack_size++] = {a, center, depth + 1};
+        continue;
+      }
+      if (a.inside()) {
+        result += integrand.weight_integral(a.t, b.t);
+      }
+    }
+    lower = upper;
+  }
+  num_evals_.fetch_add(num_evals, std::memory_order_relaxed);
+  return result;
+}
+
+}  // namespace metaball
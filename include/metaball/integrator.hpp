@@ -1,26 +1,138 @@
 #pragma once
 
-#include <functional>
+#include <atomic>
+#include <concepts>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace metaball {
 
-/*! \brief Numerical integrator on unit interval */
+class GridIntegrator;
+class TrapezoidIntegrator;
+class MonteCarloIntegrator;
+class StratifiedSamplingIntegrator;
+class GaussLaguerreIntegrator;
+class ClenshawCurtisIntegrator;
+class ImportanceSamplingIntegrator;
+class QuasiMonteCarloIntegrator;
+class AdaptiveIntegrator;
+class CrossingIntegrator;
+
+/*! \brief Integrand with smooth approximation
+ *
+ * with_surrogate(t) returns the integrand and surrogate at t, which
+ * is expected to be not much more expensive than the integrand
+ * alone.
+ */
+template <typename Func, typename ScalarType>
+concept IntegrandWithSurrogate = requires(const Func& f, ScalarType t) {
+  { f.surrogate(t) } -> std::convertible_to<ScalarType>;
+  {
+    f.with_surrogate(t)
+  } -> std::convertible_to<std::pair<ScalarType, ScalarType>>;
+};
+
+/*! \brief Integrand that can be evaluated at many points in one call
+ *
+ * evaluate(t, out) writes the integrand at each point in t to out.
+ */
+template <typename Func, typename ScalarType>
+concept BatchIntegrand = requires(const Func& f, std::span<const ScalarType> t,
+                                  std::span<ScalarType> out) {
+  f.evaluate(t, out);
+};
+
+/*! \brief Weight function restricted to level set
+ *
+ * The integrand is a weight function where a level function is
+ * non-negative, and zero elsewhere. level(t) returns the level
+ * function and its derivative at t, and weight_integral(t0, t1)
+ * returns the integral of the weight function over [t0,t1]. The
+ * integrand may only have this form for some settings, so
+ * has_level_set() is checked at runtime.
+ */
+template <typename Func, typename ScalarType>
+concept IntegrandWithLevelSet = requires(const Func& f, ScalarType t) {
+  { f.has_level_set() } -> std::convertible_to<bool>;
+  { f.level(t) } -> std::convertible_to<std::pair<ScalarType, ScalarType>>;
+  { f.weight_integral(t, t) } -> std::convertible_to<ScalarType>;
+};
+
+/*! \brief Numerical integrator on unit interval
+ *
+ * The set of integrators is closed so that integration can be
+ * statically dispatched. The integrand is a template parameter and
+ * can be inlined into the sampling loop.
+ */
 class Integrator {
  public:
   using ScalarType = double;
 
+  /*! \brief Variance reduction for stochastic integrators
+   *
+   * Antithetic sampling pairs each uniform sample u with 1-u. With a
+   * control variate, the integrand is sampled minus a smooth
+   * surrogate, and the surrogate is integrated with a midpoint rule
+   * at the same number of points. The control variate is only
+   * applied to integrands that provide a surrogate (see
+   * IntegrandWithSurrogate).
+   */
+  enum class VarianceReduction { None, Antithetic, ControlVariate };
+
+  /*! \brief Fixed evaluation points and weights on unit interval */
+  struct QuadratureRule {
+    std::vector<ScalarType> nodes;
+    std::vector<ScalarType> weights;
+  };
+
   virtual ~Integrator() = default;
 
   virtual std::string describe() const = 0;
 
-  virtual ScalarType operator()(
-      const std::function<ScalarType(ScalarType)>& integrand) const = 0;
+  /*! \brief Quadrature rule, if integrator is deterministic */
+  virtual std::optional<QuadratureRule> quadrature_rule() const;
+
+  /*! \brief Integrand evaluations since last call
+   *
+   * Only tracked by integrators whose number of evaluations varies
+   * between integrals.
+   */
+  virtual std::optional<size_t> take_num_evals() const;
+
+  /*! \brief Integrate function over unit interval */
+  template <typename Func>
+  ScalarType operator()(Func&& integrand) const;
+
+  /*! \brief Call function with concrete integrator type */
+  template <typename Visitor>
+  decltype(auto) visit(Visitor&& visitor) const;
 
   static std::unique_ptr<Integrator> make_integrator(
       const std::string_view& config);
+
+ protected:
+  enum class Type {
+    Grid,
+    Trapezoid,
+    MonteCarlo,
+    StratifiedSampling,
+    GaussLaguerre,
+    ClenshawCurtis,
+    ImportanceSampling,
+    QuasiMonteCarlo,
+    Adaptive,
+    Crossing
+  };
+
+  Integrator(Type type);
+
+ private:
+  Type type_;
 };
 
 class GridIntegrator : public Integrator {
@@ -29,8 +141,10 @@ class GridIntegrator : public Integrator {
 
   std::string describe() const override;
 
-  ScalarType operator()(
-      const std::function<ScalarType(ScalarType)>& integrand) const override;
+  std::optional<QuadratureRule> quadrature_rule() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
 
  private:
   size_t num_evals_;
@@ -42,8 +156,10 @@ class TrapezoidIntegrator : public Integrator {
 
   std::string describe() const override;
 
-  ScalarType operator()(
-      const std::function<ScalarType(ScalarType)>& integrand) const override;
+  std::optional<QuadratureRule> quadrature_rule() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
 
  private:
   size_t num_evals_;
@@ -51,29 +167,225 @@ class TrapezoidIntegrator : public Integrator {
 
 class MonteCarloIntegrator : public Integrator {
  public:
-  MonteCarloIntegrator(size_t num_evals);
+  MonteCarloIntegrator(
+      size_t num_evals,
+      VarianceReduction variance_reduction = VarianceReduction::None);
 
   std::string describe() const override;
 
-  ScalarType operator()(
-      const std::function<ScalarType(ScalarType)>& integrand) const override;
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
 
  private:
   size_t num_evals_;
+  VarianceReduction variance_reduction_;
 };
 
 class StratifiedSamplingIntegrator : public Integrator {
  public:
-  StratifiedSamplingIntegrator(size_t num_grids, size_t evals_per_grid);
+  StratifiedSamplingIntegrator(
+      size_t num_grids, size_t evals_per_grid,
+      VarianceReduction variance_reduction = VarianceReduction::None);
 
   std::string describe() const override;
 
-  ScalarType operator()(
-      const std::function<ScalarType(ScalarType)>& integrand) const override;
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
 
  private:
   size_t num_grids_;
   size_t evals_per_grid_;
+  VarianceReduction variance_reduction_;
+};
+
+/*! \brief Generalized Gauss-Laguerre quadrature matched to ray kernel
+ *
+ * Nodes and weights are for integrals over [0,inf) with weight
+ * function s*exp(-s), mapped to the unit interval with
+ * s=t/(1-t). The rule is exact when the integrand is
+ * s*exp(-s)*s'(t) times a polynomial in s of degree less than
+ * 2*num_evals.
+ */
+class GaussLaguerreIntegrator : public Integrator {
+ public:
+  GaussLaguerreIntegrator(size_t num_evals);
+
+  std::string describe() const override;
+
+  std::optional<QuadratureRule> quadrature_rule() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+ private:
+  size_t num_evals_;
+  QuadratureRule rule_;
+};
+
+/*! \brief Clenshaw-Curtis quadrature on unit interval
+ *
+ * The rule has num_evals interior nodes and two endpoint
+ * nodes. Integrands that vanish at the endpoints, like the ray
+ * kernel, only need num_evals evaluations.
+ */
+class ClenshawCurtisIntegrator : public Integrator {
+ public:
+  ClenshawCurtisIntegrator(size_t num_evals);
+
+  std::string describe() const override;
+
+  std::optional<QuadratureRule> quadrature_rule() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+ private:
+  size_t num_evals_;
+  QuadratureRule rule_;
+};
+
+/*! \brief Monte Carlo integration with samples drawn from ray kernel
+ *
+ * Samples are distributed on the unit interval like s*exp(-s) (a
+ * Gamma(2) distribution) under the map s=t/(1-t), stratified through
+ * the inverse CDF. When the integrand is the ray kernel times a
+ * density, the estimate is an average of densities.
+ */
+class ImportanceSamplingIntegrator : public Integrator {
+ public:
+  ImportanceSamplingIntegrator(
+      size_t num_evals,
+      VarianceReduction variance_reduction = VarianceReduction::None);
+
+  std::string describe() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+  /*! \brief Map uniform sample to sample from ray kernel
+   *
+   * \param[in] u Uniform sample in [0,1)
+   * \return Point in unit interval and probability density there
+   */
+  static std::pair<ScalarType, ScalarType> sample(const ScalarType& u);
+
+ private:
+  size_t num_evals_;
+  VarianceReduction variance_reduction_;
+};
+
+/*! \brief Randomized quasi-Monte Carlo integration
+ *
+ * Evaluates a rank-1 lattice, which in 1D is a uniform grid, with a
+ * random Cranley-Patterson rotation for each integral. Lattice
+ * points are mapped to the ray kernel distribution like in
+ * ImportanceSamplingIntegrator. Only one random number is drawn per
+ * integral, and the error decays like 1/num_evals for integrands
+ * with bounded variation.
+ */
+class QuasiMonteCarloIntegrator : public Integrator {
+ public:
+  QuasiMonteCarloIntegrator(size_t num_evals);
+
+  std::string describe() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+ private:
+  size_t num_evals_;
+};
+
+/*! \brief Adaptive Gauss-Kronrod integration with error control
+ *
+ * The integral is mapped to the CDF of the ray kernel, like in
+ * ImportanceSamplingIntegrator, and split into intervals with equal
+ * kernel mass. Intervals are integrated with the 7-point Gauss and
+ * 15-point Kronrod rules, and the interval with the largest error
+ * estimate is bisected until the total error is within tolerance.
+ *
+ * The integrand is assumed to be bounded by the ray kernel, i.e. the
+ * density is in [0,1], so the tail of the kernel with less mass than
+ * half the absolute tolerance is skipped. Features narrower than the
+ * initial intervals may be missed, and step discontinuities from a
+ * hard density threshold converge slowly.
+ */
+class AdaptiveIntegrator : public Integrator {
+ public:
+  AdaptiveIntegrator(ScalarType abs_tol, ScalarType rel_tol, size_t max_evals,
+                     size_t num_initial_intervals);
+
+  std::string describe() const override;
+
+  std::optional<size_t> take_num_evals() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+ private:
+  ScalarType abs_tol_;
+  ScalarType rel_tol_;
+  size_t max_evals_;
+  size_t num_initial_intervals_;
+
+  /*! \brief Upper limit of integration */
+  ScalarType tail_cutoff_;
+  /*! \brief Bound on integral beyond upper limit */
+  ScalarType tail_bound_;
+
+  mutable std::atomic<size_t> num_evals_{0};
+};
+
+/*! \brief Integration of level sets by root finding
+ *
+ * For integrands with a level set (see IntegrandWithLevelSet), e.g.
+ * the ray kernel with a hard density threshold. The unit interval
+ * is split into num_brackets intervals with equal ray kernel mass,
+ * like in ImportanceSamplingIntegrator. The level function is
+ * evaluated at the bracket edges, crossings are located with Newton
+ * iterations safeguarded by bisection, and the weight function is
+ * integrated analytically between crossings. Crossings are located
+ * within tolerance.
+ *
+ * The result has no sampling noise, but it is biased by crossings
+ * that are missed, and its accuracy depends on num_brackets. Two
+ * crossings within one bracket are only found if the bracket is
+ * bisected. This is done, up to max_subdivisions times, if the
+ * tangents at both ends cross zero within the bracket, which catches
+ * any dip of a convex or concave level function but misses others.
+ *
+ * Brackets are fixed, so their mass is only equal if the integrand
+ * does not remap the unit interval, e.g. onto the ray segments that
+ * need sampling in Scene::trace_ray. Other integrands, e.g. with a
+ * soft density threshold, are integrated by importance sampling with
+ * one sample per bracket, so results are noisy.
+ */
+class CrossingIntegrator : public Integrator {
+ public:
+  CrossingIntegrator(size_t num_brackets, ScalarType tolerance);
+
+  std::string describe() const override;
+
+  std::optional<size_t> take_num_evals() const override;
+
+  template <typename Func>
+  ScalarType integrate(Func&& integrand) const;
+
+ private:
+  template <typename Func>
+  ScalarType integrate_level_set(const Func& integrand) const;
+
+  size_t num_brackets_;
+  ScalarType tolerance_;
+  std::vector<ScalarType> bracket_edges_;
+
+  static constexpr size_t max_subdivisions = 4;
+  static constexpr size_t max_newton_iters = 64;
+
+  mutable std::atomic<size_t> num_evals_{0};
 };
 
 }  // namespace metaball
+
+// Implementation
+#include "metaball/impl/integrator.hpp"
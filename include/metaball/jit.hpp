@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+#include "metaball/scene.hpp"
+
+namespace metaball {
+namespace jit {
+
+using ScalarType = Scene::ScalarType;
+using VectorType = Scene::VectorType;
+
+/*! \brief Scene density kernel compiled at runtime
+ *
+ * Wraps a shared library, built from the output of generate_source
+ * and loaded with dlopen. The library is closed when the kernel is
+ * destroyed.
+ */
+class DensityKernel {
+ public:
+  ~DensityKernel();
+
+  DensityKernel(const DensityKernel&) = delete;
+  DensityKernel& operator=(const DensityKernel&) = delete;
+
+  /*! \brief Load kernel from shared library */
+  static std::unique_ptr<DensityKernel> load(
+      const std::filesystem::path& library);
+
+  /*! \brief Sum of scene elements at multiple positions */
+  void compute_scores(std::span<const VectorType> positions,
+                      std::span<ScalarType> scores) const;
+
+  /*! \brief Thresholded sum of scene elements at multiple positions
+   *
+   * The threshold is passed at runtime so that changing it does not
+   * require recompiling.
+   */
+  void compute_densities(std::span<const VectorType> positions,
+                         std::span<ScalarType> densities,
+                         ScalarType threshold,
+                         ScalarType threshold_width) const;
+
+ private:
+  using ScoresFunction = void (*)(const ScalarType*, ScalarType*, size_t);
+  using DensitiesFunction = void (*)(const ScalarType*, ScalarType*, size_t,
+                                     ScalarType, ScalarType);
+
+  DensityKernel(void* handle, ScoresFunction scores_function,
+                DensitiesFunction densities_function);
+
+  void* handle_;
+  ScoresFunction scores_function_;
+  DensitiesFunction densities_function_;
+};
+
+/*! \brief Density kernel that may still be compiling
+ *
+ * Compilation runs in a background thread. Checking whether it has
+ * finished is lock-free, so it can be done for every ray.
+ */
+class KernelBuild {
+ public:
+  KernelBuild();
+
+  /*! \brief Kernel if compilation has finished successfully
+   *
+   * Returns null while compiling or if compilation failed.
+   */
+  const DensityKernel* kernel() const;
+
+  bool finished() const;
+
+  /*! \brief Block until compilation finishes */
+  void wait() const;
+
+  /*! \brief Set result and wake waiting threads */
+  void finish(std::unique_ptr<const DensityKernel>&& kernel);
+
+ private:
+  std::unique_ptr<const DensityKernel> kernel_;
+  std::atomic<bool> finished_ = false;
+  std::promise<void> finished_promise_;
+  std::shared_future<void> finished_future_;
+};
+
+/*! \brief Maximum element terms in a generated kernel
+ *
+ * Source size and compile time grow linearly with the number of
+ * terms, at about 5 ms per term, and each scene leaves a kernel in
+ * the cache.
+ */
+constexpr size_t max_source_terms = 1024;
+
+/*! \brief Generate C++ source for density kernel
+ *
+ * Every element is unrolled with its parameters as literals (see
+ * SceneElement::source_terms). Returns nothing if there are more than
+ * max_source_terms terms.
+ */
+std::optional<std::string> generate_source(
+    std::span<const PackedSceneElement> elements, Scene::Accuracy accuracy);
+
+/*! \brief Compile density kernel with the system C++ compiler
+ *
+ * Shared libraries are cached on disk, keyed by a hash of the source
+ * and compile command. A cached kernel is loaded immediately.
+ * Otherwise compilation runs in a background thread, which gives up
+ * without compiling if the build is discarded within debounce_time,
+ * e.g. because the scene has changed again. Failures are reported
+ * as warnings and leave the build without a kernel.
+ *
+ * The compiler is the one used to build metaball, or
+ * METABALL_JIT_COMPILER if set. Kernels are cached in
+ * METABALL_JIT_CACHE_DIR, or in metaball-jit in the temp directory.
+ */
+std::shared_ptr<KernelBuild> build_kernel(std::string source);
+
+/*! \brief Delay before compiling, to skip builds that are discarded */
+inline constexpr double debounce_time = 0.1;
+
+/*! \brief C++ literal that reproduces value exactly */
+std::string literal(ScalarType value);
+
+}  // namespace jit
+}  // namespace metaball
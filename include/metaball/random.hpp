@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <random>
 
 namespace metaball {
@@ -8,6 +9,9 @@ namespace random {
 /*! Thread-local RNG */
 std::mt19937& generator();
 
+/*! Reseed thread-local RNG for reproducible results */
+void seed(uint32_t value);
+
 /*! Generate uniform random scalar or vector */
 template <typename T>
 T rand();
@@ -48,6 +48,7 @@ class Runner : public QWidget {
   Scene scene_;
   std::unique_ptr<Integrator> integrator_;
   Camera camera_;
+  std::optional<size_t> last_frame_num_evals_;
 
   QTimer timer_;
   size_t timer_interval_{50};  // milliseconds
@@ -1,23 +1,71 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <utility>
+#include <variant>
 #include <vector>
 
 #include "metaball/integrator.hpp"
+#include "util/brick_cache.hpp"
+#include "util/hash_grid.hpp"
+#include "util/simd_math.hpp"
 #include "util/vector.hpp"
 
 namespace metaball {
 
+namespace jit {
+class DensityKernel;
+class KernelBuild;
+}  // namespace jit
+
 class SceneElement;
+class RaySceneElements;
+class RadialSceneElement;
+class MultiRadialSceneElement;
+class PolynomialSceneElement;
+class SinusoidSceneElement;
+class MultiSinusoidSceneElement;
+class RadialSinusoidSceneElement;
+class PolarSinusoidSceneElement;
+class MinusExpSceneElement;
+class MetaballSceneElement;
+
+/*! \brief Falloff of metaball with compact support
+ *
+ * Kernels are functions of q=r^2/R^2, with R the metaball radius,
+ * that decrease from 1 at the center to 0 with zero slope at the
+ * radius, and are zero beyond it. Wyvill is the soft object kernel
+ * 1-22/9*q+17/9*q^2-4/9*q^3. Quintic is 1-10*a^3+15*a^4-6*a^5 with
+ * a=r/R, which also has zero curvature at the radius.
+ */
+enum class MetaballFalloff { Wyvill, Quintic };
+
+/*! \brief Scene element stored by value
+ *
+ * Closed set of concrete element types, so that elements can be
+ * stored contiguously and evaluated without virtual calls.
+ */
+using PackedSceneElement =
+    std::variant<RadialSceneElement, MultiRadialSceneElement,
+                 PolynomialSceneElement, SinusoidSceneElement,
+                 MultiSinusoidSceneElement, RadialSinusoidSceneElement,
+                 PolarSinusoidSceneElement, MinusExpSceneElement,
+                 MetaballSceneElement>;
 
 class Scene {
  public:
   static constexpr size_t ndim = 4;
   using ScalarType = Integrator::ScalarType;
   using VectorType = util::Vector<ndim, ScalarType>;
+  using Accuracy = util::simd_math::Accuracy;
 
   Scene();
 
@@ -27,24 +75,547 @@ class Scene {
   void set_density_threshold(const ScalarType& threshold);
   void set_density_threshold_width(const ScalarType& width);
 
+  /*! \brief Accuracy of transcendental functions
+   *
+   * Applies to the density threshold and to all scene elements,
+   * including elements added later.
+   */
+  Accuracy math_accuracy() const;
+  void set_math_accuracy(Accuracy accuracy);
+
+  /*! \brief Opening angle for far-field approximation of radial elements
+   *
+   * Zero by default, i.e. exact. See MultiRadialSceneElement.
+   */
+  ScalarType far_field_theta() const;
+  void set_far_field_theta(const ScalarType& theta);
+
+  /*! \brief Tolerance for NUFFT evaluation of sinusoids along rays
+   *
+   * Zero by default, i.e. exact. When positive, batches of depths
+   * along a ray sum their sinusoids with a non-uniform FFT (see
+   * util/nufft.hpp) whenever it is estimated to be cheaper than
+   * direct summation.
+   */
+  ScalarType nufft_tolerance() const;
+  void set_nufft_tolerance(const ScalarType& tolerance);
+
+  /*! \brief Band-limit sinusoids to the footprint of ray samples
+   *
+   * Opt-in. When enabled, sinusoid components are replaced by their
+   * average over the spatial footprint passed to trace_ray, so that
+   * frequencies above the sampling rate fade out instead of
+   * aliasing. The density threshold is widened by the variance that
+   * is averaged out. JIT kernels, the non-uniform FFT, and score
+   * bounds are not used for band-limited rays.
+   */
+  bool frequency_lod() const;
+  void set_frequency_lod(bool enabled);
+
+  /*! \brief Grid spacing of density cache
+   *
+   * Opt-in, zero by default. When positive, rays interpolate scores
+   * from a world-space grid that is filled on demand and cleared
+   * whenever the scene changes (see util::BrickCache), so that a
+   * static scene costs about one interpolation per sample. Cells
+   * double in width with each octave of depth beyond
+   * density_cache_near_depth. Cached rays are not restricted to the
+   * ray, so score bounds and frequency LOD are not used.
+   */
+  ScalarType density_cache_spacing() const;
+  void set_density_cache_spacing(const ScalarType& spacing);
+
+  /*! \brief Runtime compilation of density kernel
+   *
+   * Opt-in. When enabled, C++ source for the compiled elements is
+   * generated and built with the system compiler whenever the scene
+   * changes (see metaball/jit.hpp). The interpreted kernels are used
+   * until the build finishes, or if it fails. Scenes with metaballs
+   * are not compiled, since their hash grid is faster than a kernel
+   * that sums every metaball. Neither are scenes with a far field
+   * approximation (see far_field_theta), which a kernel would sum
+   * exactly, or with more than jit::max_source_terms terms.
+   */
+  bool jit_enabled() const;
+  void set_jit_enabled(bool enabled);
+
+  /*! \brief Whether a JIT kernel for the current scene is in use */
+  bool jit_ready() const;
+
+  /*! \brief Block until JIT build for the current scene finishes */
+  void wait_for_jit() const;
+
+  /*! \brief Scene elements
+   *
+   * Elements are only accessed as const, since each change is also
+   * applied to the packed copies used for evaluation.
+   */
   void add_element(std::unique_ptr<SceneElement>&& element);
-  SceneElement& get_element(size_t idx);
   const SceneElement& get_element(size_t idx) const;
   void remove_element(size_t idx);
 
   size_t num_elements() const;
 
+  /*! \brief Optimized scene elements used for evaluation
+   *
+   * See compile_elements.
+   */
+  const std::vector<PackedSceneElement>& compiled_elements() const;
+
+  /*! \brief Sum of scene elements, before density threshold */
+  ScalarType compute_score(const VectorType& position) const;
   ScalarType compute_density(const VectorType& position) const;
 
+  /*! \brief Sum of scene elements at multiple positions
+   *
+   * Each element is evaluated at all positions in one call.
+   */
+  void compute_scores(std::span<const VectorType> positions,
+                      std::span<ScalarType> scores) const;
+  void compute_densities(std::span<const VectorType> positions,
+                         std::span<ScalarType> densities) const;
+
+  /*! \brief Precomputed sample depths and weights for ray integration
+   *
+   * Deterministic integrators evaluate every ray at the same depths,
+   * so the ray decay kernel and integral reparametrization can be
+   * folded into the quadrature weights once per frame.
+   */
+  struct IntegrationPlan {
+    std::vector<ScalarType> depths;
+    std::vector<ScalarType> weights;
+
+    /*! \brief Range of nodes in each ray segment
+     *
+     * Nodes are sorted by ray segment, and segment k contains nodes
+     * segment_offsets[k] to segment_offsets[k+1]. Nodes in segments
+     * with known density are skipped (see classify_ray_segments).
+     */
+    std::vector<size_t> segment_offsets;
+  };
+
+  /*! \brief Construct integration plan
+   *
+   * Returns nothing if the integrator is not deterministic.
+   */
+  static std::optional<IntegrationPlan> make_integration_plan(
+      const Integrator& integrator);
+
+  /*! \brief Integrate density along ray
+   *
+   * Scene elements are first restricted to the ray (see
+   * RaySceneElements), unless scores are interpolated from the
+   * density cache. With a hard density threshold, segments of
+   * the ray with known density are integrated analytically and only
+   * the rest are sampled (see classify_ray_segments).
+   *
+   * The integrand provides a smooth surrogate for integrators with
+   * control variates. The surrogate is the density with a sigmoid
+   * threshold at least surrogate_threshold_width wide, computed from
+   * the same scene element sum. With a hard density threshold, it
+   * also provides the level set where the score is above the
+   * threshold (see IntegrandWithLevelSet), so that CrossingIntegrator
+   * can integrate it exactly.
+   *
+   * footprint is the width of a sample per unit depth, e.g. the
+   * angle between neighboring pixels, and is only used with
+   * frequency LOD (see frequency_lod).
+   */
+  ScalarType trace_ray(const VectorType& origin, const VectorType& orientation,
+                       const Integrator& integrator,
+                       const ScalarType& footprint = 0.) const;
   ScalarType trace_ray(const VectorType& origin, const VectorType& orientation,
-                       const Integrator& integrator) const;
+                       const IntegrationPlan& plan,
+                       const ScalarType& footprint = 0.) const;
+
+  /*! \brief Density at each node of integration plan along ray
+   *
+   * As in trace_ray, but densities are returned instead of summed,
+   * e.g. so that they can be shared between neighboring rays. Nodes
+   * in segments with known density are not sampled.
+   */
+  void sample_ray(const VectorType& origin, const VectorType& orientation,
+                  const IntegrationPlan& plan, std::span<ScalarType> densities,
+                  const ScalarType& footprint = 0.) const;
+
+  /*! \brief Number of depths sampled along rays since last call
+   *
+   * Counts integrand evaluations in trace_ray and nodes sampled by
+   * sample_ray. Segments with known density are not sampled, so they
+   * are not counted.
+   */
+  size_t take_num_ray_samples() const;
 
  private:
-  ScalarType apply_density_threshold(const ScalarType& score) const;
+  /*! \brief Density of score
+   *
+   * variance is that of score over the sample footprint (see
+   * RaySceneElements::compute_score_and_variance). The density is
+   * averaged over it by widening the threshold, approximating the
+   * expected sigmoid of a Gaussian score with a sigmoid of width
+   * sqrt(width^2+pi/8*variance).
+   */
+  ScalarType apply_density_threshold(const ScalarType& score,
+                                     const ScalarType& variance = 0.) const;
+  ScalarType apply_surrogate_threshold(const ScalarType& score,
+                                       const ScalarType& variance = 0.) const;
+
+  /*! \brief Minimum sigmoid width for control variate surrogate */
+  static constexpr ScalarType surrogate_threshold_width = 0.02;
+
+  /*! \brief Map point in unit interval to ray depth and kernel weight
+   *
+   * The weight includes the ray decay kernel and the Jacobian of the
+   * map from [0,inf) to [0,1].
+   */
+  static std::pair<ScalarType, ScalarType> ray_depth_and_weight(
+      const ScalarType& t);
+
+  /*! \brief Derivative of ray depth with respect to t
+   *
+   * t is in the unit interval, as in ray_depth_and_weight.
+   */
+  static ScalarType ray_depth_derivative(const ScalarType& t);
+
+  /*! \brief Depth where ray decay kernel peaks */
+  static constexpr ScalarType ray_depth_scale = 1;
+
+  /*! \brief Integral of ray decay kernel over [t0,t1]
+   *
+   * t is in the unit interval, as in ray_depth_and_weight.
+   */
+  static ScalarType ray_kernel_integral(const ScalarType& t0,
+                                        const ScalarType& t1);
+
+  /*! \brief Depth up to which density cache cells are finest */
+  static constexpr ScalarType density_cache_near_depth = 2 * ray_depth_scale;
+
+  /*! \brief Number of ray segments classified with score bounds */
+  static constexpr size_t num_ray_segments = 8;
+
+  /*! \brief Classify ray segments by density
+   *
+   * The unit interval of ray_depth_and_weight is split into
+   * num_ray_segments equal segments. With a hard density threshold,
+   * a segment where score bounds (see
+   * RaySceneElements::compute_score_bounds) are entirely above or
+   * below the threshold has constant density. Indices of the other
+   * segments are written to uncertain_segments. If segment_densities
+   * is not empty, the density of each constant segment is written to
+   * it.
+   *
+   * \return Integral over segments with constant density
+   */
+  ScalarType classify_ray_segments(
+      const RaySceneElements& elements, std::vector<size_t>& uncertain_segments,
+      std::span<ScalarType> segment_densities = {}) const;
+
+  /*! \brief Restrict elements to ray and classify ray segments
+   *
+   * See restrict_to_ray and classify_ray_segments. With the density
+   * cache, elements are left empty and every segment is uncertain.
+   *
+   * \return Integral over segments with constant density
+   */
+  ScalarType prepare_ray(const VectorType& origin, const VectorType& direction,
+                         const ScalarType& footprint,
+                         RaySceneElements& elements,
+                         std::vector<size_t>& uncertain_segments,
+                         std::span<ScalarType> segment_densities = {}) const;
+
+  /*! \brief Optimize scene elements into packed storage
+   *
+   * Runs whenever the scene changes. Sums of elements are flattened
+   * into their components, all sinusoid components are fused into
+   * one multi-sinusoid, all radial elements into one multi-radial,
+   * and all metaballs into one element, and elements that are zero
+   * everywhere are dropped. Packed elements are grouped by type so
+   * that evaluation runs one type at a time.
+   */
+  void compile_elements();
+
+  /*! \brief JIT kernel if enabled and built, otherwise null */
+  const jit::DensityKernel* jit_kernel() const;
+
+  /*! \brief Project compiled elements onto ray
+   *
+   * Direction must be a unit vector. Footprint is as in trace_ray.
+   */
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       const ScalarType& footprint,
+                       RaySceneElements& ray) const;
+
+  /*! \brief Densities at multiple depths along ray
+   *
+   * Uses the density cache if enabled, the JIT kernel if it is ready
+   * and the elements are not band-limited, and otherwise the elements
+   * restricted to the ray.
+   */
+  void compute_ray_densities(const VectorType& origin,
+                             const VectorType& direction,
+                             const RaySceneElements& elements,
+                             std::span<const ScalarType> depths,
+                             std::span<ScalarType> densities) const;
+
+  /*! \brief Scores at multiple depths along ray from density cache
+   *
+   * Missing bricks are filled with compute_scores.
+   */
+  void interpolate_ray_scores(const VectorType& origin,
+                              const VectorType& direction,
+                              std::span<const ScalarType> depths,
+                              std::span<ScalarType> scores) const;
+
+  /*! \brief Apply density threshold in place
+   *
+   * Variances are as in the scalar version, and are zero if empty.
+   */
+  void apply_density_threshold(
+      std::span<ScalarType> scores,
+      std::span<const ScalarType> variances = {}) const;
 
   std::vector<std::unique_ptr<SceneElement>> elements_;
+  std::vector<PackedSceneElement> compiled_elements_;
   ScalarType density_threshold_ = 0.25;
   ScalarType density_threshold_width_ = 0.;
+  Accuracy math_accuracy_ = Accuracy::Full;
+  ScalarType far_field_theta_ = 0.;
+  ScalarType nufft_tolerance_ = 0.;
+  bool frequency_lod_ = false;
+  bool jit_enabled_ = false;
+  std::shared_ptr<jit::KernelBuild> jit_build_;
+  std::unique_ptr<util::BrickCache<ndim, ScalarType>> density_cache_;
+  // Note: Counter is on the heap so that scenes are movable.
+  std::unique_ptr<std::atomic<size_t>> num_ray_samples_ =
+      std::make_unique<std::atomic<size_t>>(0);
+};
+
+/*! \brief Scene elements restricted to a ray
+ *
+ * Along the ray origin + x*direction, with direction a unit vector,
+ * each scene element is a function of the depth x alone. Elements
+ * are projected onto the ray once per ray (see
+ * SceneElement::restrict_to_ray), so that each sample costs a few
+ * scalar operations per element instead of ndim-dimensional vector
+ * arithmetic.
+ *
+ * Forms are grouped by type and stored as structures of arrays.
+ * Single depths are vectorized over elements and batches of depths
+ * are vectorized over depths.
+ *
+ * Distances to a point c are given by shift=(origin-c).direction and
+ * perp2=|origin-c-shift*direction|^2, so that the squared distance
+ * at depth x is (x+shift)^2+perp2. This avoids cancellation for rays
+ * that pass close to c. Phases are in cycles.
+ */
+class RaySceneElements {
+ public:
+  using ScalarType = Scene::ScalarType;
+  using VectorType = Scene::VectorType;
+  using Accuracy = Scene::Accuracy;
+
+  /*! \brief Remove all elements, keeping allocated storage
+   *
+   * Sinusoids are summed with a non-uniform FFT for batches of
+   * depths if nufft_tolerance is positive. Sinusoid elements add
+   * band-limited forms if footprint is positive.
+   */
+  void reset(Accuracy accuracy, ScalarType nufft_tolerance = 0.,
+             ScalarType footprint = 0.);
+
+  size_t num_elements() const;
+
+  /*! \brief Width of samples per unit depth, or zero if not band-limited */
+  ScalarType footprint() const;
+
+  /*! \brief Whether any forms are band-limited */
+  bool band_limited() const;
+
+  /*! \brief Sort band-limited forms by rate
+   *
+   * Must be called after adding band-limited forms and before
+   * evaluating, so that the forms not dropped at a depth are a
+   * prefix. Forms that are already sorted, e.g. from a fused
+   * multi-sinusoid, are not moved.
+   */
+  void sort_band_limited();
+
+  /*! \brief Rate of band-limited forms for wavenumber
+   *
+   * Samples at depth x are averaged over a Gaussian footprint with
+   * standard deviation footprint*x/2, which scales a sinusoid with
+   * wavenumber k (in cycles) by exp(-rate*x^2), where
+   * rate=pi^2/2*(footprint*k)^2.
+   */
+  ScalarType band_limit_rate(ScalarType wavenumber_square) const;
+
+  /*! \brief amplitude/(1+decay_square*r^2) */
+  void add_radial(ScalarType shift, ScalarType perp2, ScalarType decay_square,
+                  ScalarType amplitude = 1.);
+
+  /*! \brief Polynomial in x
+   *
+   * Coefficients are in order of increasing degree and evaluated with
+   * Horner's method.
+   */
+  void add_polynomial(std::span<const ScalarType> coefficients);
+
+  /*! \brief amplitude*cos(2*pi*(frequency*x+phase)) */
+  void add_sinusoid(ScalarType frequency, ScalarType phase,
+                    ScalarType amplitude);
+
+  /*! \brief Append sinusoids to be filled in by caller
+   *
+   * Returns frequencies, phases, and amplitudes of the new sinusoids,
+   * so that many sinusoids can be projected in one SIMD loop.
+   */
+  std::array<std::span<ScalarType>, 3> add_sinusoids(size_t count);
+
+  /*! \brief Sinusoid averaged over sample footprint
+   *
+   * About amplitude*cos(2*pi*(frequency*x+phase))*exp(-rate*x^2),
+   * with a Gaussian factor that is truncated to zero where
+   * rate*x^2>=16 (see band_limit_rate). Only depths where it is not
+   * dropped are evaluated.
+   */
+  void add_band_limited_sinusoid(ScalarType frequency, ScalarType phase,
+                                 ScalarType amplitude, ScalarType rate);
+
+  /*! \brief Append band-limited sinusoids to be filled in by caller
+   *
+   * Returns frequencies, phases, amplitudes, and rates, as in
+   * add_sinusoids.
+   */
+  std::array<std::span<ScalarType>, 4> add_band_limited_sinusoids(
+      size_t count);
+
+  /*! \brief amplitude*cos(2*pi*(frequency*r+phase)) */
+  void add_radial_sinusoid(ScalarType shift, ScalarType perp2,
+                           ScalarType frequency, ScalarType phase,
+                           ScalarType amplitude);
+
+  /*! \brief Radial sinusoid averaged over sample footprint
+   *
+   * Scaled by exp(-rate*x^2), as in add_band_limited_sinusoid.
+   */
+  void add_band_limited_radial_sinusoid(ScalarType shift, ScalarType perp2,
+                                        ScalarType frequency,
+                                        ScalarType phase,
+                                        ScalarType amplitude,
+                                        ScalarType rate);
+
+  /*! \brief Sinusoid of distance and polar angle
+   *
+   * amplitude*cos(2*pi*(radial_frequency*r+polar_frequency*theta+phase)),
+   * where cos(theta)=(axial_slope*x+axial_offset)/r.
+   */
+  void add_polar_sinusoid(ScalarType shift, ScalarType perp2,
+                          ScalarType axial_slope, ScalarType axial_offset,
+                          ScalarType radial_frequency,
+                          ScalarType polar_frequency, ScalarType phase,
+                          ScalarType amplitude);
+
+  /*! \brief -expm1(dist_scale_square*r^2) */
+  void add_minus_exp(ScalarType shift, ScalarType perp2,
+                     ScalarType dist_scale_square);
+
+  /*! \brief Metaball kernel of q=inv_radius_square*r^2
+   *
+   * See MetaballFalloff. Only depths where the kernel is nonzero
+   * are evaluated if depths are sorted.
+   */
+  void add_metaball(ScalarType shift, ScalarType perp2,
+                    ScalarType inv_radius_square, MetaballFalloff falloff);
+
+  /*! \brief Sum of elements at depth
+   *
+   * Band-limited forms contribute their average over the footprint.
+   */
+  ScalarType compute_score(ScalarType depth) const;
+
+  /*! \brief Sum of elements and variance averaged out at depth
+   *
+   * The variance is that of the band-limited forms over the
+   * footprint, which is lost by averaging them. It is zero if no
+   * forms are band-limited.
+   */
+  std::pair<ScalarType, ScalarType> compute_score_and_variance(
+      ScalarType depth) const;
+
+  /*! \brief Sum of elements and its derivative with respect to depth */
+  std::pair<ScalarType, ScalarType> compute_score_and_derivative(
+      ScalarType depth) const;
+
+  /*! \brief Sum of elements at multiple depths
+   *
+   * Variances averaged out, as in compute_score_and_variance, are
+   * written to variances unless it is empty.
+   */
+  void compute_scores(std::span<const ScalarType> depths,
+                      std::span<ScalarType> scores,
+                      std::span<ScalarType> variances = {}) const;
+
+  /*! \brief Conservative bounds on sum of elements over depth intervals
+   *
+   * Interval k is [depth_edges[k],depth_edges[k+1]], so there is one
+   * less interval than edges. Sinusoids, band-limited or not, are
+   * only bounded by their amplitudes. Bounds are widened to allow
+   * for rounding and for the error of the approximate math
+   * functions.
+   */
+  void compute_score_bounds(std::span<const ScalarType> depth_edges,
+                            std::span<ScalarType> lower,
+                            std::span<ScalarType> upper) const;
+
+ private:
+  /*! \brief Parameters of one type of form, as structure of arrays */
+  template <size_t num_params>
+  struct Forms {
+    std::array<std::vector<ScalarType>, num_params> params;
+
+    size_t size() const;
+    void clear();
+    void push_back(const std::array<ScalarType, num_params>& values);
+    std::array<std::span<ScalarType>, num_params> append(size_t count);
+    /*! \brief Stable sort by one parameter */
+    void sort_by(size_t index);
+  };
+
+  template <Accuracy accuracy>
+  ScalarType compute_score_impl(ScalarType depth,
+                                ScalarType* variance = nullptr) const;
+  template <Accuracy accuracy>
+  std::pair<ScalarType, ScalarType> compute_score_and_derivative_impl(
+      ScalarType depth) const;
+  template <Accuracy accuracy>
+  void compute_scores_impl(std::span<const ScalarType> depths,
+                           std::span<ScalarType> scores,
+                           std::span<ScalarType> variances) const;
+
+  /*! \brief Variance of band-limited forms before averaging */
+  ScalarType band_limited_variance() const;
+
+  void check_band_limited_sorted() const;
+
+  /*! \brief Whether to sum sinusoids at depths with a non-uniform FFT */
+  bool use_nufft(std::span<const ScalarType> depths) const;
+
+  Accuracy accuracy_ = Accuracy::Full;
+  ScalarType nufft_tolerance_ = 0.;
+  ScalarType footprint_ = 0.;
+  bool band_limited_sorted_ = true;
+  Forms<4> radials_;
+  std::vector<ScalarType> polynomial_coefficients_;
+  /*! \brief Start of each polynomial in polynomial_coefficients_ */
+  std::vector<size_t> polynomial_offsets_ = {0};
+  Forms<3> sinusoids_;
+  Forms<4> band_limited_sinusoids_;
+  Forms<5> radial_sinusoids_;
+  Forms<6> band_limited_radial_sinusoids_;
+  Forms<8> polar_sinusoids_;
+  Forms<3> minus_exps_;
+  Forms<3> wyvill_metaballs_;
+  Forms<3> quintic_metaballs_;
 };
 
 class SceneElement {
@@ -52,15 +623,55 @@ class SceneElement {
   static constexpr size_t ndim = Scene::ndim;
   using ScalarType = Scene::ScalarType;
   using VectorType = Scene::VectorType;
+  using Accuracy = Scene::Accuracy;
 
   virtual ~SceneElement() = default;
 
   virtual ScalarType operator()(const VectorType& position) const = 0;
 
+  /*! \brief Evaluate at multiple positions
+   *
+   * Values are written to out, or added to out if accumulate is
+   * true. A single virtual call covers all positions, so the loop
+   * over positions can be inlined and vectorized.
+   */
+  virtual void evaluate(std::span<const VectorType> positions,
+                        std::span<ScalarType> out, bool accumulate) const = 0;
+
   virtual std::string describe() const = 0;
 
+  /*! \brief Whether element is zero at every position
+   *
+   * Conservative, e.g. false if unsure.
+   */
+  virtual bool is_zero() const;
+
+  /*! \brief C++ expressions that sum to value at (x0, x1, x2, x3)
+   *
+   * Used to generate JIT kernels (see metaball/jit.hpp), where
+   * accuracy, square, and util::simd_math are available. Large sums
+   * are split into several terms so that the compiler can inline and
+   * vectorize each one.
+   */
+  virtual std::vector<std::string> source_terms() const;
+
+  /*! \brief Append 1D form along ray
+   *
+   * Direction must be a unit vector.
+   */
+  virtual void restrict_to_ray(const VectorType& origin,
+                               const VectorType& direction,
+                               RaySceneElements& ray) const;
+
+  /*! \brief Accuracy of transcendental functions in kernels */
+  Accuracy accuracy() const;
+  virtual void set_accuracy(Accuracy accuracy);
+
   static std::unique_ptr<SceneElement> make_element(
       const std::string_view& config);
+
+ protected:
+  Accuracy accuracy_ = Accuracy::Full;
 };
 
 class MultiSceneElement : public SceneElement {
@@ -68,10 +679,20 @@ class MultiSceneElement : public SceneElement {
   MultiSceneElement();
 
   void add_element(std::unique_ptr<SceneElement>&& element);
+  const SceneElement& get_element(size_t idx) const;
+  size_t num_elements() const;
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  void set_accuracy(Accuracy accuracy) override;
 
  private:
   std::vector<std::unique_ptr<SceneElement>> elements_;
@@ -83,22 +704,110 @@ class RadialSceneElement : public SceneElement {
                      const ScalarType& decay = 1.);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  const VectorType& center() const;
+  ScalarType decay_square() const;
 
  private:
   VectorType center_;
   ScalarType decay_square_;
 };
 
+/*! \brief Sum of radial elements with far-field approximation
+ *
+ * Components are stored in a k-d tree, with a separate tree for each
+ * decay. With a nonzero opening angle theta, a node whose components
+ * are within s of their centroid is approximated by one radial
+ * element at the centroid, scaled by the number of components, if s
+ * is less than theta times the distance to the position, as in
+ * Barnes and Hut, "A hierarchical O(N log N) force-calculation
+ * algorithm" (1986). Dipole terms vanish at the centroid, so the
+ * relative error of each approximated node is O(theta^2). For rays,
+ * the distance is to the nearest point on the ray, so each ray gets
+ * one form per approximated node. With theta=0, every component is
+ * evaluated exactly. JIT kernels evaluate every component.
+ */
+class MultiRadialSceneElement : public SceneElement {
+ public:
+  struct Component {
+    VectorType center;
+    ScalarType decay_square;
+  };
+
+  MultiRadialSceneElement(std::vector<Component> components = {},
+                          ScalarType far_field_theta = 0.);
+
+  ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
+
+  std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  /*! \brief Components, in tree order */
+  const std::vector<Component>& components() const;
+
+  ScalarType far_field_theta() const;
+
+ private:
+  /*! \brief Node of k-d tree
+   *
+   * Components begin to end are in the node. The left child follows
+   * the node, and leaves have no right child.
+   */
+  struct Node {
+    VectorType centroid;
+    ScalarType radius_square;
+    ScalarType decay_square;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t right;
+  };
+
+  /*! \brief Maximum number of components in leaf */
+  static constexpr size_t leaf_size = 8;
+
+  std::vector<Component> components_;
+  ScalarType far_field_theta_;
+  std::vector<Node> nodes_;
+  /*! \brief Root of tree for each decay */
+  std::vector<uint32_t> roots_;
+
+  uint32_t build_tree(size_t begin, size_t end);
+
+  /*! \brief Visit nodes of trees
+   *
+   * accept(node) returns whether the node is approximated, and
+   * leaf(begin, end) is called for components of other leaves.
+   */
+  template <typename Accept, typename Leaf>
+  void visit_tree(Accept&& accept, Leaf&& leaf) const;
+};
+
 class PolynomialSceneElement : public SceneElement {
  public:
   PolynomialSceneElement(std::vector<VectorType> coefficients,
                          const VectorType& center = {});
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
 
  private:
   std::vector<VectorType> coefficients_;
@@ -112,30 +821,70 @@ class SinusoidSceneElement : public SceneElement {
                        const ScalarType& amplitude = 1.);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  const VectorType& wave_vector() const;
+  ScalarType phase() const;
+  ScalarType amplitude() const;
 
  private:
   VectorType wave_vector_;
   ScalarType phase_;
   ScalarType amplitude_;
+
+  template <Accuracy accuracy>
+  ScalarType evaluate_one(const VectorType& position) const;
 };
 
+/*! \brief Sum of sinusoids
+ *
+ * Components are stored as a structure of arrays and evaluated with
+ * a SIMD loop over components, using a polynomial cosine (see
+ * util::simd_math::cos_cycles). At full accuracy, each cosine is
+ * within 3e-15 of the exact value. A scalar loop with
+ * std::cos(2*pi*(k.x+phase)) also rounds the angle, so the two agree
+ * within about 1e-15*(1+|k.x+phase|) times the amplitude per
+ * component, plus rounding from summing in a different order.
+ */
 class MultiSinusoidSceneElement : public SceneElement {
  public:
   MultiSinusoidSceneElement(
-      std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components);
+      const std::vector<std::tuple<VectorType, ScalarType, ScalarType>>&
+          components);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  /*! \brief Wave vector, phase, and amplitude of each component */
+  std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components()
+      const;
 
   static std::unique_ptr<MultiSinusoidSceneElement> make_power_spectrum_decay(
       size_t num_components, ScalarType frequency_cutoff,
       ScalarType decay_factor);
 
  private:
-  std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components_;
+  /*! \brief Wave vector components, indexed by dimension then component */
+  std::array<std::vector<ScalarType>, ndim> wave_vectors_;
+  std::vector<ScalarType> phases_;
+  std::vector<ScalarType> amplitudes_;
+
+  template <Accuracy accuracy>
+  ScalarType evaluate_one(const VectorType& position) const;
 };
 
 class RadialSinusoidSceneElement : public SceneElement {
@@ -146,14 +895,26 @@ class RadialSinusoidSceneElement : public SceneElement {
                              const ScalarType& amplitude = 1.);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
 
  private:
   VectorType center_;
   ScalarType frequency_;
   ScalarType phase_;
   ScalarType amplitude_;
+
+  /*! \brief Phase in cycles, i.e. divided by 2*pi */
+  ScalarType phase_cycles_;
+
+  template <Accuracy accuracy>
+  ScalarType evaluate_one(const VectorType& position) const;
 };
 
 class PolarSinusoidSceneElement : public SceneElement {
@@ -166,8 +927,14 @@ class PolarSinusoidSceneElement : public SceneElement {
                             const ScalarType& amplitude = 1.);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
 
  private:
   VectorType center_;
@@ -176,6 +943,12 @@ class PolarSinusoidSceneElement : public SceneElement {
   ScalarType polar_frequency_;
   ScalarType phase_;
   ScalarType amplitude_;
+
+  /*! \brief Phase in cycles, i.e. divided by 2*pi */
+  ScalarType phase_cycles_;
+
+  template <Accuracy accuracy>
+  ScalarType evaluate_one(const VectorType& position) const;
 };
 
 class MinusExpSceneElement : public SceneElement {
@@ -184,12 +957,75 @@ class MinusExpSceneElement : public SceneElement {
                        const ScalarType& dist_scale = 1.);
 
   ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
 
   std::string describe() const override;
+  bool is_zero() const override;
+  std::vector<std::string> source_terms() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
 
  private:
   VectorType center_;
   ScalarType dist_scale_square_;
+
+  template <Accuracy accuracy>
+  ScalarType evaluate_one(const VectorType& position) const;
+};
+
+/*! \brief Sum of metaballs with compact support
+ *
+ * Metaballs are indexed by a uniform hash grid (see util::HashGrid)
+ * with cells as wide as the largest metaball. Evaluating at a
+ * position only visits the metaballs in its cell, and restricting to
+ * a ray only visits the cells crossed by the ray, so costs depend on
+ * how many metaballs overlap rather than on the total number. Scenes
+ * with metaballs are not JIT compiled (see Scene::jit_enabled).
+ */
+class MetaballSceneElement : public SceneElement {
+ public:
+  struct Metaball {
+    VectorType center;
+    ScalarType radius;
+    MetaballFalloff falloff;
+  };
+
+  MetaballSceneElement(const std::vector<Metaball>& metaballs = {});
+
+  ScalarType operator()(const VectorType& position) const override;
+  void evaluate(std::span<const VectorType> positions,
+                std::span<ScalarType> out, bool accumulate) const override;
+
+  std::string describe() const override;
+  bool is_zero() const override;
+  void restrict_to_ray(const VectorType& origin, const VectorType& direction,
+                       RaySceneElements& ray) const override;
+
+  const std::vector<Metaball>& metaballs() const;
+
+  /*! \brief Add metaballs to the end
+   *
+   * The grid is updated incrementally, unless a new metaball is
+   * larger than the grid cells.
+   */
+  void append(std::span<const Metaball> metaballs);
+
+  /*! \brief Remove metaballs from the end
+   *
+   * The grid is updated incrementally.
+   */
+  void truncate(size_t size);
+
+ private:
+  std::vector<Metaball> metaballs_;
+  util::HashGrid<ndim, ScalarType> grid_;
+  /*! \brief Bounding box of metaballs */
+  VectorType lower_;
+  VectorType upper_;
+
+  void rebuild_grid();
+  void update_bounds();
 };
 
 }  // namespace metaball
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "util/vector.hpp"
+
+namespace util {
+
+/*! \brief Sparse grid of cached function values
+ *
+ * Space is tiled by bricks of brick_size^NDim cells, each storing
+ * the function at its (brick_size+1)^NDim nodes. Bricks are filled
+ * the first time a position inside them is interpolated, and values
+ * between nodes are multilinear interpolations. Each level of detail
+ * has its own grid, with cells 2^level times the base spacing.
+ *
+ * Interpolating is thread-safe, so bricks can be filled on demand by
+ * render threads. Bricks are never evicted. Once max_bricks are
+ * cached, positions in missing bricks are evaluated directly.
+ */
+template <size_t NDim, typename Scalar = double>
+class BrickCache {
+ public:
+  using VectorType = Vector<NDim, Scalar>;
+  using BrickIndex = std::array<int64_t, NDim + 1>;
+
+  /*! \brief Number of cells along each edge of a brick */
+  static constexpr size_t brick_size = 4;
+
+  /*! \brief Number of nodes in a brick */
+  static constexpr size_t brick_nodes = [] {
+    size_t result = 1;
+    for (size_t d = 0; d < NDim; ++d) {
+      result *= brick_size + 1;
+    }
+    return result;
+  }();
+
+  BrickCache(Scalar spacing = 1, size_t max_bricks = 1 << 14);
+
+  /*! \brief Width of cells at level 0 */
+  Scalar spacing() const;
+
+  size_t max_bricks() const;
+  size_t num_bricks() const;
+
+  /*! \brief Remove all bricks
+   *
+   * Not thread-safe with interpolate.
+   */
+  void clear();
+
+  /*! \brief Interpolate function at positions
+   *
+   * levels is the level of detail for each position. Missing bricks
+   * are filled by calling fill(nodes, values), which must write the
+   * function at each node position into values. fill is also called
+   * for positions that are evaluated directly.
+   */
+  template <typename Fill>
+  void interpolate(std::span<const VectorType> positions,
+                   std::span<const int> levels, std::span<Scalar> values,
+                   Fill&& fill);
+
+ private:
+  using Brick = std::array<Scalar, brick_nodes>;
+
+  struct BrickHash {
+    size_t operator()(const BrickIndex& index) const;
+  };
+
+  /*! \brief Brick map with its own lock
+   *
+   * Bricks are distributed over shards by hash, so that threads
+   * filling different bricks rarely contend.
+   */
+  struct Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<BrickIndex, std::unique_ptr<const Brick>, BrickHash>
+        bricks;
+  };
+
+  static constexpr size_t num_shards = 64;
+
+  /*! \brief Cached brick, filling it if missing
+   *
+   * Returns null if the brick is missing and the cache is full.
+   */
+  template <typename Fill>
+  const Brick* find_or_fill(const BrickIndex& index, Fill&& fill);
+
+  Scalar spacing_;
+  size_t max_bricks_;
+  std::atomic<size_t> num_bricks_ = 0;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace util
+
+// Implementation
+#include "util/impl/brick_cache.hpp"
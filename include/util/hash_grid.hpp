@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "util/vector.hpp"
+
+namespace util {
+
+/*! \brief Uniform grid of cells, stored sparsely in a hash table
+ *
+ * Each cell holds indices of the items whose bounding boxes overlap
+ * it. Items are inserted one at a time, and the most recently
+ * inserted items can be removed, so the grid is updated rather than
+ * rebuilt when items are appended or truncated.
+ */
+template <size_t NDim, typename Scalar = double>
+class HashGrid {
+ public:
+  using VectorType = Vector<NDim, Scalar>;
+  using CellIndex = std::array<int64_t, NDim>;
+  using ItemIndex = uint32_t;
+
+  HashGrid(Scalar cell_size = 1);
+
+  Scalar cell_size() const;
+
+  /*! \brief Remove all items */
+  void clear();
+
+  /*! \brief Add item to cells overlapping box [lower,upper] */
+  void insert(ItemIndex item, const VectorType& lower,
+              const VectorType& upper);
+
+  /*! \brief Remove item from cells overlapping box [lower,upper]
+   *
+   * The item must be the last one inserted into each of these cells,
+   * e.g. if items are removed in reverse order of insertion.
+   */
+  void remove_last(ItemIndex item, const VectorType& lower,
+                   const VectorType& upper);
+
+  /*! \brief Cell containing position */
+  CellIndex cell_index(const VectorType& position) const;
+
+  /*! \brief Items overlapping cell */
+  std::span<const ItemIndex> items(const CellIndex& cell) const;
+
+  /*! \brief Visit cells crossed by line segment
+   *
+   * Calls visitor with the items of each non-empty cell crossed by
+   * origin + x*direction for x in [x_min,x_max], in order of
+   * increasing x. Cells are traversed as in Amanatides and Woo, "A
+   * Fast Voxel Traversal Algorithm for Ray Tracing" (1987). The
+   * segment must be finite.
+   */
+  template <typename Visitor>
+  void visit_segment(const VectorType& origin, const VectorType& direction,
+                     Scalar x_min, Scalar x_max, Visitor&& visitor) const;
+
+ private:
+  /*! \brief Apply function to every cell overlapping box */
+  template <typename Func>
+  void for_each_cell(const VectorType& lower, const VectorType& upper,
+                     Func&& func) const;
+
+  /*! \brief Position in hash table of cell, or of empty slot for it */
+  size_t find_slot(const CellIndex& cell) const;
+
+  /*! \brief Double size of hash table */
+  void grow_table();
+
+  Scalar cell_size_;
+  Scalar inv_cell_size_;
+  std::vector<CellIndex> cells_;
+  std::vector<std::vector<ItemIndex>> cell_items_;
+  /*! \brief Open addressing table of 1 + index in cells_, or 0 if empty
+   *
+   * Size is a power of 2 and at least twice the number of cells.
+   */
+  std::vector<uint32_t> table_;
+};
+
+}  // namespace util
+
+// Implementation
+#include "util/impl/hash_grid.hpp"
@@ -0,0 +1,198 @@
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
+#include "util/error.hpp"
+
+namespace util {
+
+template <size_t NDim, typename Scalar>
+inline BrickCache<NDim, Scalar>::BrickCache(Scalar spacing, size_t max_bricks)
+    : spacing_{spacing},
+      max_bricks_{max_bricks},
+      shards_{std::make_unique<Shard[]>(num_shards)} {
+  UTIL_CHECK(spacing_ > 0, "Invalid brick cache spacing (", spacing_, ")");
+}
+
+template <size_t NDim, typename Scalar>
+inline Scalar BrickCache<NDim, Scalar>::spacing() const {
+  return spacing_;
+}
+
+template <size_t NDim, typename Scalar>
+inline size_t BrickCache<NDim, Scalar>::max_bricks() const {
+  return max_bricks_;
+}
+
+template <size_t NDim, typename Scalar>
+inline size_t BrickCache<NDim, Scalar>::num_bricks() const {
+  return num_bricks_;
+}
+
+template <size_t NDim, typename Scalar>
+inline void BrickCache<NDim, Scalar>::clear() {
+  for (size_t k = 0; k < num_shards; ++k) {
+    shards_[k].bricks.clear();
+  }
+  num_bricks_ = 0;
+}
+
+template <size_t NDim, typename Scalar>
+template <typename Fill>
+inline void BrickCache<NDim, Scalar>::interpolate(
+    std::span<const VectorType> positions, std::span<const int> levels,
+    std::span<Scalar> values, Fill&& fill) {
+  UTIL_CHECK(positions.size() == levels.size() &&
+                 positions.size() == values.size(),
+             "Attempted to interpolate at ", positions.size(),
+             " positions with ", levels.size(), " levels into ", values.size(),
+             " outputs");
+
+  // Strides of node dimensions within brick
+  constexpr auto strides = [] {
+    std::array<size_t, NDim> strides;
+    size_t stride = 1;
+    for (size_t d = 0; d < NDim; ++d) {
+      strides[d] = stride;
+      stride *= brick_size + 1;
+    }
+    return strides;
+  }();
+
+  // Note: Consecutive positions, e.g. along a ray, are often in the
+  // same brick, so the previous brick is checked before the shards.
+  constexpr auto size = static_cast<int64_t>(brick_size);
+  thread_local std::vector<size_t> missing;
+  missing.clear();
+  const Brick* brick = nullptr;
+  BrickIndex brick_index;
+  bool found = false;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    // Find cell containing position
+    const auto level = levels[i];
+    const auto inv_cell_size = 1 / std::ldexp(spacing_, level);
+    BrickIndex index;
+    index[0] = level;
+    size_t offset = 0;
+    std::array<Scalar, NDim> fractions;
+    for (size_t d = 0; d < NDim; ++d) {
+      const auto x = positions[i][d] * inv_cell_size;
+      const auto cell = std::floor(x);
+      fractions[d] = x - cell;
+      const auto cell_index = static_cast<int64_t>(cell);
+      const auto brick_coord = cell_index >= 0
+                                   ? cell_index / size
+                                   : (cell_index + 1) / size - 1;
+      index[d + 1] = brick_coord;
+      offset += (cell_index - brick_coord * size) * strides[d];
+    }
+    if (!found || index != brick_index) {
+      brick = find_or_fill(index, fill);
+      brick_index = index;
+      found = true;
+    }
+    if (brick == nullptr) {
+      missing.push_back(i);
+      continue;
+    }
+
+    // Multilinear interpolation over cell corners
+    Scalar value = 0;
+    for (size_t corner = 0; corner < (size_t{1} << NDim); ++corner) {
+      Scalar weight = 1;
+      size_t corner_offset = offset;
+      for (size_t d = 0; d < NDim; ++d) {
+        if (corner & (size_t{1} << d)) {
+          weight *= fractions[d];
+          corner_offset += strides[d];
+        } else {
+          weight *= 1 - fractions[d];
+        }
+      }
+      value += weight * (*brick)[corner_offset];
+    }
+    values[i] = value;
+  }
+
+  // Evaluate positions in bricks that could not be cached
+  if (!missing.empty()) {
+    thread_local std::vector<VectorType> missing_positions;
+    thread_local std::vector<Scalar> missing_values;
+    missing_positions.resize(missing.size());
+    missing_values.resize(missing.size());
+    for (size_t j = 0; j < missing.size(); ++j) {
+      missing_positions[j] = positions[missing[j]];
+    }
+    fill(std::span<const VectorType>(missing_positions),
+         std::span<Scalar>(missing_values));
+    for (size_t j = 0; j < missing.size(); ++j) {
+      values[missing[j]] = missing_values[j];
+    }
+  }
+}
+
+template <size_t NDim, typename Scalar>
+inline size_t BrickCache<NDim, Scalar>::BrickHash::operator()(
+    const BrickIndex& index) const {
+  // Note: Same mixing as HashGrid.
+  constexpr std::array<uint64_t, 4> primes = {
+      0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9,
+      0x27d4eb2f165667c5};
+  uint64_t hash = 0;
+  for (size_t d = 0; d < index.size(); ++d) {
+    hash += static_cast<uint64_t>(index[d]) * primes[d % primes.size()];
+  }
+  return hash ^ (hash >> 32);
+}
+
+template <size_t NDim, typename Scalar>
+template <typename Fill>
+inline const typename BrickCache<NDim, Scalar>::Brick*
+BrickCache<NDim, Scalar>::find_or_fill(const BrickIndex& index, Fill&& fill) {
+  // Look up cached brick
+  auto& shard = shards_[BrickHash{}(index) % num_shards];
+  {
+    std::shared_lock lock(shard.mutex);
+    const auto it = shard.bricks.find(index);
+    if (it != shard.bricks.end()) {
+      return it->second.get();
+    }
+  }
+  if (num_bricks_ >= max_bricks_) {
+    return nullptr;
+  }
+
+  // Evaluate function at nodes
+  // Note: Filling happens outside the lock, since it is much slower
+  // than a lookup. Threads that fill the same brick concurrently
+  // compute the same values, and only the first is kept.
+  thread_local std::vector<VectorType> nodes;
+  auto brick = std::make_unique<Brick>();
+  nodes.resize(brick_nodes);
+  const auto cell_size = std::ldexp(spacing_, index[0]);
+  for (size_t n = 0; n < brick_nodes; ++n) {
+    size_t rest = n;
+    for (size_t d = 0; d < NDim; ++d) {
+      const auto node = static_cast<int64_t>(rest % (brick_size + 1));
+      rest /= brick_size + 1;
+      nodes[n][d] = (index[d + 1] * static_cast<int64_t>(brick_size) + node) *
+                    cell_size;
+    }
+  }
+  fill(std::span<const VectorType>(nodes), std::span<Scalar>(*brick));
+
+  // Insert brick
+  std::unique_lock lock(shard.mutex);
+  auto [it, inserted] = shard.bricks.try_emplace(index, std::move(brick));
+  if (inserted) {
+    ++num_bricks_;
+  }
+  return it->second.get();
+}
+
+}  // namespace util
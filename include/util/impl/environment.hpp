@@ -13,7 +13,7 @@ inline T getenv(const std::string& variable, const T& default_value) {
   if (env == nullptr || env[0] == '\0') {
     return default_value;
   }
-  return from_string<T>(env);
+  return from_string<T>(std::string_view(env));
 }
 
 template <typename T>
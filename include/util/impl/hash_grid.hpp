@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "util/error.hpp"
+
+namespace util {
+
+template <size_t NDim, typename Scalar>
+inline HashGrid<NDim, Scalar>::HashGrid(Scalar cell_size)
+    : cell_size_{cell_size}, inv_cell_size_{1 / cell_size}, table_(16, 0) {
+  UTIL_CHECK(cell_size_ > 0, "Invalid cell size (", cell_size_, ")");
+}
+
+template <size_t NDim, typename Scalar>
+inline Scalar HashGrid<NDim, Scalar>::cell_size() const {
+  return cell_size_;
+}
+
+template <size_t NDim, typename Scalar>
+inline void HashGrid<NDim, Scalar>::clear() {
+  cells_.clear();
+  cell_items_.clear();
+  std::fill(table_.begin(), table_.end(), 0);
+}
+
+template <size_t NDim, typename Scalar>
+inline void HashGrid<NDim, Scalar>::insert(ItemIndex item,
+                                           const VectorType& lower,
+                                           const VectorType& upper) {
+  for_each_cell(lower, upper, [&](const CellIndex& cell) {
+    auto slot = find_slot(cell);
+    if (table_[slot] == 0) {
+      if (2 * (cells_.size() + 1) > table_.size()) {
+        grow_table();
+        slot = find_slot(cell);
+      }
+      cells_.push_back(cell);
+      cell_items_.emplace_back();
+      table_[slot] = cells_.size();
+    }
+    cell_items_[table_[slot] - 1].push_back(item);
+  });
+}
+
+template <size_t NDim, typename Scalar>
+inline void HashGrid<NDim, Scalar>::remove_last(ItemIndex item,
+                                                const VectorType& lower,
+                                                const VectorType& upper) {
+  // Note: Emptied cells are kept in the table, since they are likely
+  // to be filled again.
+  for_each_cell(lower, upper, [&](const CellIndex& cell) {
+    const auto slot = find_slot(cell);
+    UTIL_CHECK(table_[slot] != 0, "Attempted to remove item ", item,
+               " from empty cell");
+    auto& items = cell_items_[table_[slot] - 1];
+    UTIL_CHECK(!items.empty() && items.back() == item,
+               "Attempted to remove item ", item,
+               " that was not the last inserted into its cell");
+    items.pop_back();
+  });
+}
+
+template <size_t NDim, typename Scalar>
+inline typename HashGrid<NDim, Scalar>::CellIndex
+HashGrid<NDim, Scalar>::cell_index(const VectorType& position) const {
+  CellIndex cell;
+  for (size_t d = 0; d < NDim; ++d) {
+    cell[d] = static_cast<int64_t>(std::floor(position[d] * inv_cell_size_));
+  }
+  return cell;
+}
+
+template <size_t NDim, typename Scalar>
+inline std::span<const typename HashGrid<NDim, Scalar>::ItemIndex>
+HashGrid<NDim, Scalar>::items(const CellIndex& cell) const {
+  const auto idx = table_[find_slot(cell)];
+  if (idx == 0) {
+    return {};
+  }
+  return cell_items_[idx - 1];
+}
+
+template <size_t NDim, typename Scalar>
+template <typename Visitor>
+inline void HashGrid<NDim, Scalar>::visit_segment(const VectorType& origin,
+                                                  const VectorType& direction,
+                                                  Scalar x_min, Scalar x_max,
+                                                  Visitor&& visitor) const {
+  UTIL_CHECK(std::isfinite(x_min) && std::isfinite(x_max),
+             "Attempted to visit cells along infinite segment [", x_min, ",",
+             x_max, "]");
+  if (x_min > x_max) {
+    return;
+  }
+
+  // Depths where segment crosses next cell boundary in each dimension
+  const auto start = origin + x_min * direction;
+  auto cell = cell_index(start);
+  std::array<Scalar, NDim> next_x, step_x;
+  std::array<int64_t, NDim> step;
+  for (size_t d = 0; d < NDim; ++d) {
+    if (direction[d] == 0) {
+      next_x[d] = std::numeric_limits<Scalar>::infinity();
+      step_x[d] = 0;
+      step[d] = 0;
+      continue;
+    }
+    const bool forward = direction[d] > 0;
+    const Scalar boundary = cell_size_ * (cell[d] + (forward ? 1 : 0));
+    next_x[d] = x_min + (boundary - start[d]) / direction[d];
+    step_x[d] = cell_size_ / std::abs(direction[d]);
+    step[d] = forward ? 1 : -1;
+  }
+
+  // Step to neighboring cell with nearest boundary
+  while (true) {
+    const auto cell_items = items(cell);
+    if (!cell_items.empty()) {
+      visitor(cell_items);
+    }
+    const size_t d = std::min_element(next_x.begin(), next_x.end()) -
+                     next_x.begin();
+    if (next_x[d] > x_max) {
+      break;
+    }
+    cell[d] += step[d];
+    next_x[d] += step_x[d];
+  }
+}
+
+template <size_t NDim, typename Scalar>
+template <typename Func>
+inline void HashGrid<NDim, Scalar>::for_each_cell(const VectorType& lower,
+                                                  const VectorType& upper,
+                                                  Func&& func) const {
+  const auto first = cell_index(lower);
+  const auto last = cell_index(upper);
+  auto cell = first;
+  while (true) {
+    func(cell);
+    size_t d = 0;
+    for (; d < NDim; ++d) {
+      if (cell[d] < last[d]) {
+        ++cell[d];
+        break;
+      }
+      cell[d] = first[d];
+    }
+    if (d == NDim) {
+      break;
+    }
+  }
+}
+
+template <size_t NDim, typename Scalar>
+inline size_t HashGrid<NDim, Scalar>::find_slot(const CellIndex& cell) const {
+  // Note: Coordinates are mixed with large odd constants, as in
+  // Teschner et al, "Optimized Spatial Hashing for Collision
+  // Detection of Deformable Objects" (2003), and high bits are moved
+  // down since the table size is a power of 2.
+  constexpr std::array<uint64_t, 4> primes = {
+      0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9,
+      0x27d4eb2f165667c5};
+  uint64_t hash = 0;
+  for (size_t d = 0; d < NDim; ++d) {
+    hash += static_cast<uint64_t>(cell[d]) * primes[d % primes.size()];
+  }
+  hash ^= hash >> 32;
+  const size_t mask = table_.size() - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    const auto idx = table_[slot];
+    if (idx == 0 || cells_[idx - 1] == cell) {
+      return slot;
+    }
+  }
+}
+
+template <size_t NDim, typename Scalar>
+inline void HashGrid<NDim, Scalar>::grow_table() {
+  table_.assign(2 * table_.size(), 0);
+  for (size_t i = 0; i < cells_.size(); ++i) {
+    table_[find_slot(cells_[i])] = i + 1;
+  }
+}
+
+}  // namespace util
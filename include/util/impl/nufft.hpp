@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "util/error.hpp"
+#include "util/simd_math.hpp"
+
+namespace util {
+namespace nufft {
+
+namespace impl {
+
+/*! \brief Parameters of Gaussian gridding
+ *
+ * Points are shifted by center into [-half_range,half_range]. The
+ * grid spacing is 1/(4*half_range), i.e. oversampled by 2 so that
+ * aliased copies of the points are at least 3*half_range away. Each
+ * term is spread over 2*half_width+1 grid frequencies with a Gaussian
+ * of the given variance. With u=2*pi^2*variance*half_range^2, the
+ * aliasing error is about exp(-8*u) and the truncation error, after
+ * deconvolving, about exp(u-pi^2*half_width^2/(16*u)). These balance
+ * at u=pi*half_width/12, with error exp(-2*pi*half_width/3).
+ */
+struct Gridding {
+  double center;
+  double half_range;
+  double spacing;
+  double variance;
+  int64_t half_width;
+  /*! \brief Index of first grid frequency */
+  int64_t grid_begin;
+  size_t grid_size;
+};
+
+/*! \brief Half width of Gaussian kernel for tolerance */
+inline int64_t kernel_half_width(double tolerance) {
+  UTIL_CHECK(tolerance > 0 && tolerance < 1, "Invalid NUFFT tolerance (",
+             tolerance, ")");
+  constexpr double pi = std::numbers::pi;
+  return std::max<int64_t>(
+      2, static_cast<int64_t>(std::ceil(-3 * std::log(tolerance) / (2 * pi))));
+}
+
+/*! \brief Largest grid index, before adding kernel half width */
+inline double max_grid_index(double max_frequency, double half_range) {
+  return std::ceil(4 * max_frequency * half_range);
+}
+
+inline Gridding make_gridding(double max_frequency, double point_min,
+                              double point_max, double tolerance) {
+  constexpr double pi = std::numbers::pi;
+  Gridding gridding;
+  gridding.center = (point_min + point_max) / 2;
+  gridding.half_range =
+      point_max > point_min ? (point_max - point_min) / 2 : 1;
+  gridding.spacing = 1 / (4 * gridding.half_range);
+  gridding.half_width = kernel_half_width(tolerance);
+  gridding.variance = gridding.half_width /
+                      (24 * pi * gridding.half_range * gridding.half_range);
+  const auto max_index = max_grid_index(max_frequency, gridding.half_range);
+  UTIL_CHECK(max_index < (int64_t{1} << 32), "NUFFT grid is too large (",
+             "max frequency ", max_frequency, ", point range ",
+             point_max - point_min, ")");
+  gridding.grid_begin = -static_cast<int64_t>(max_index) - gridding.half_width;
+  gridding.grid_size = 1 - 2 * gridding.grid_begin;
+  return gridding;
+}
+
+/*! \brief Number of terms in each block of Gaussian weights */
+inline constexpr size_t block_size = 64;
+
+/*! \brief Scratch buffers, reused between calls on each thread */
+struct Buffers {
+  std::vector<double> grid_real;
+  std::vector<double> grid_imag;
+  std::vector<double> term_real;
+  std::vector<double> term_imag;
+  std::vector<double> term_index;
+  std::vector<double> term_weight;
+  std::vector<double> term_ratio;
+  std::vector<double> offset_weights;
+  std::vector<double> block_kernels;
+  std::vector<double> point_sum;
+  std::vector<double> point_real;
+  std::vector<double> point_imag;
+  std::vector<double> point_step_real;
+  std::vector<double> point_step_imag;
+};
+
+inline Buffers& buffers() {
+  thread_local Buffers buffers;
+  return buffers;
+}
+
+}  // namespace impl
+
+inline void add_cosine_sum(std::span<const double> frequencies,
+                           std::span<const double> phases,
+                           std::span<const double> amplitudes,
+                           std::span<const double> points,
+                           std::span<double> out, double tolerance) {
+  UTIL_CHECK(phases.size() == frequencies.size() &&
+                 amplitudes.size() == frequencies.size(),
+             "Cosine terms do not match (", frequencies.size(),
+             " frequencies, ", phases.size(), " phases, ", amplitudes.size(),
+             " amplitudes)");
+  UTIL_CHECK(out.size() == points.size(), "Attempted to evaluate ",
+             points.size(), " points into ", out.size(), " outputs");
+  if (frequencies.empty() || points.empty()) {
+    return;
+  }
+  constexpr double pi = std::numbers::pi;
+  const size_t num_terms = frequencies.size();
+  const size_t num_points = points.size();
+  double max_frequency = 0;
+  for (const auto& frequency : frequencies) {
+    max_frequency = std::max(max_frequency, std::abs(frequency));
+  }
+  const auto [point_min, point_max] =
+      std::minmax_element(points.begin(), points.end());
+  const auto gridding =
+      impl::make_gridding(max_frequency, *point_min, *point_max, tolerance);
+  const auto center = gridding.center;
+  const auto spacing = gridding.spacing;
+  const auto variance = gridding.variance;
+  const auto half_width = gridding.half_width;
+  const size_t kernel_size = 2 * half_width + 1;
+
+  // Gaussian factors of grid offsets
+  auto& buffers = impl::buffers();
+  buffers.offset_weights.resize(kernel_size);
+  for (int64_t l = -half_width; l <= half_width; ++l) {
+    const auto offset = l * spacing;
+    buffers.offset_weights[l + half_width] =
+        std::exp(-offset * offset / (2 * variance));
+  }
+
+  // Complex amplitudes, with phases shifted to the center point, and
+  // nearest grid frequencies
+  // Note: The Gaussian at grid offset l from the nearest frequency is
+  // exp(-(l*spacing-delta)^2/(2*variance)), which factors into
+  // exp(-delta^2/(2*variance)), ratio^l, and the offset weight, with
+  // ratio=exp(spacing*delta/variance).
+  buffers.term_real.resize(num_terms);
+  buffers.term_imag.resize(num_terms);
+  buffers.term_index.resize(num_terms);
+  buffers.term_weight.resize(num_terms);
+  buffers.term_ratio.resize(num_terms);
+  {
+    const auto* frequency_data = frequencies.data();
+    const auto* phase_data = phases.data();
+    const auto* amplitude_data = amplitudes.data();
+    auto* real = buffers.term_real.data();
+    auto* imag = buffers.term_imag.data();
+    auto* index = buffers.term_index.data();
+    auto* weight = buffers.term_weight.data();
+    auto* ratio = buffers.term_ratio.data();
+    const double first_offset = static_cast<double>(half_width) * spacing;
+#pragma omp simd
+    for (size_t j = 0; j < num_terms; ++j) {
+      const auto frequency = frequency_data[j];
+      const auto angle = phase_data[j] + frequency * center;
+      real[j] = amplitude_data[j] * simd_math::cos_cycles(angle);
+      imag[j] = amplitude_data[j] * simd_math::cos_cycles(angle - 0.25);
+      const auto nearest = simd_math::impl::round_nearest(frequency / spacing);
+      const auto delta = frequency - nearest * spacing;
+      index[j] = nearest;
+      weight[j] = simd_math::exp(-delta * (delta + 2 * first_offset) /
+                                 (2 * variance));
+      ratio[j] = simd_math::exp(spacing * delta / variance);
+    }
+  }
+
+  // Spread terms onto grid
+  // Note: Gaussian weights are computed for blocks of terms with a
+  // SIMD loop over terms, since each is a product over grid offsets.
+  buffers.grid_real.assign(gridding.grid_size, 0);
+  buffers.grid_imag.assign(gridding.grid_size, 0);
+  buffers.block_kernels.resize(kernel_size * impl::block_size);
+  for (size_t block = 0; block < num_terms; block += impl::block_size) {
+    const size_t size = std::min(impl::block_size, num_terms - block);
+    auto* weight = &buffers.term_weight[block];
+    const auto* ratio = &buffers.term_ratio[block];
+    for (size_t l = 0; l < kernel_size; ++l) {
+      const auto offset_weight = buffers.offset_weights[l];
+      auto* kernels = &buffers.block_kernels[l];
+#pragma omp simd
+      for (size_t j = 0; j < size; ++j) {
+        kernels[j * kernel_size] = weight[j] * offset_weight;
+        weight[j] *= ratio[j];
+      }
+    }
+    for (size_t j = 0; j < size; ++j) {
+      const auto first = static_cast<int64_t>(buffers.term_index[block + j]) -
+                         half_width - gridding.grid_begin;
+      auto* grid_real = &buffers.grid_real[first];
+      auto* grid_imag = &buffers.grid_imag[first];
+      const auto real = buffers.term_real[block + j];
+      const auto imag = buffers.term_imag[block + j];
+      const auto* kernels = &buffers.block_kernels[j * kernel_size];
+#pragma omp simd
+      for (size_t l = 0; l < kernel_size; ++l) {
+        const auto kernel = kernels[l];
+        grid_real[l] += kernel * real;
+        grid_imag[l] += kernel * imag;
+      }
+    }
+  }
+
+  // Sum grid at points
+  // Note: Phase factors exp(2*pi*i*m*spacing*y) are updated by
+  // complex multiplication, vectorized over points.
+  buffers.point_sum.assign(num_points, 0);
+  buffers.point_real.resize(num_points);
+  buffers.point_imag.resize(num_points);
+  buffers.point_step_real.resize(num_points);
+  buffers.point_step_imag.resize(num_points);
+  {
+    auto* sum = buffers.point_sum.data();
+    auto* real = buffers.point_real.data();
+    auto* imag = buffers.point_imag.data();
+    auto* step_real = buffers.point_step_real.data();
+    auto* step_imag = buffers.point_step_imag.data();
+    const auto* point_data = points.data();
+    const double grid_begin = static_cast<double>(gridding.grid_begin);
+#pragma omp simd
+    for (size_t s = 0; s < num_points; ++s) {
+      const auto y = point_data[s] - center;
+      const auto angle = grid_begin * spacing * y;
+      real[s] = simd_math::cos_cycles(angle);
+      imag[s] = simd_math::cos_cycles(angle - 0.25);
+      step_real[s] = simd_math::cos_cycles(spacing * y);
+      step_imag[s] = simd_math::cos_cycles(spacing * y - 0.25);
+    }
+    for (size_t m = 0; m < gridding.grid_size; ++m) {
+      const auto grid_real = buffers.grid_real[m];
+      const auto grid_imag = buffers.grid_imag[m];
+#pragma omp simd
+      for (size_t s = 0; s < num_points; ++s) {
+        sum[s] += grid_real * real[s] - grid_imag * imag[s];
+        const auto next_real = real[s] * step_real[s] - imag[s] * step_imag[s];
+        imag[s] = real[s] * step_imag[s] + imag[s] * step_real[s];
+        real[s] = next_real;
+      }
+    }
+  }
+
+  // Deconvolve by Fourier transform of Gaussian,
+  // sqrt(2*pi*variance)*exp(-2*pi^2*variance*y^2)
+  const auto scale = spacing / std::sqrt(2 * pi * variance);
+  for (size_t s = 0; s < num_points; ++s) {
+    const auto y = points[s] - center;
+    out[s] += scale * buffers.point_sum[s] *
+              std::exp(2 * pi * pi * variance * y * y);
+  }
+}
+
+inline double relative_cost(size_t num_terms, size_t num_points,
+                            double max_frequency, double point_range,
+                            double tolerance) {
+  if (num_terms == 0 || num_points == 0) {
+    return 1;
+  }
+  // Note: Costs are in units of one cosine in a SIMD loop. Spreading
+  // a term costs a few cosines plus a multiply-add per grid offset,
+  // and summing a grid frequency at a point costs about one cosine.
+  constexpr double term_cost = 6, offset_cost = 0.75, grid_cost = 0.3;
+  const auto half_width = impl::kernel_half_width(tolerance);
+  const double half_range = point_range > 0 ? point_range / 2 : 1;
+  const double num_offsets = 2 * half_width + 1;
+  const double grid_size =
+      2 * (impl::max_grid_index(max_frequency, half_range) + half_width) + 1;
+  const double cost = num_terms * (term_cost + offset_cost * num_offsets) +
+                      grid_cost * num_points * grid_size;
+  return cost / (static_cast<double>(num_terms) * num_points);
+}
+
+}  // namespace nufft
+}  // namespace util
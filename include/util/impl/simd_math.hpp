@@ -0,0 +1,247 @@
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <string_view>
+#include <utility>
+
+#include "util/error.hpp"
+
+// Macro to force inlining, so that calls do not prevent vectorizing
+// loops in large functions
+#if defined(__GNUC__)
+#define UTIL_SIMD_INLINE [[gnu::always_inline]] inline
+#else
+#define UTIL_SIMD_INLINE inline
+#endif
+
+namespace util {
+namespace simd_math {
+
+namespace impl {
+
+/*! \brief Taylor coefficients x^(offset+step*k)/(offset+step*k)!
+ *
+ * With alternate signs if alternating is true.
+ */
+template <size_t N>
+constexpr std::array<double, N> taylor_coefficients(size_t offset, size_t step,
+                                                    bool alternating) {
+  std::array<double, N> coeffs{};
+  double factorial = 1;
+  size_t n = 0;
+  for (size_t k = 0; k < N; ++k) {
+    const size_t power = offset + step * k;
+    for (; n < power; ++n) {
+      factorial *= n + 1;
+    }
+    coeffs[k] = (alternating && k % 2 == 1 ? -1 : 1) / factorial;
+  }
+  return coeffs;
+}
+
+/*! \brief Evaluate polynomial with Horner's method */
+template <size_t N>
+UTIL_SIMD_INLINE double horner(const std::array<double, N>& coeffs, double x) {
+  double result = coeffs[N - 1];
+  for (size_t k = N - 1; k-- > 0;) {
+    result = result * x + coeffs[k];
+  }
+  return result;
+}
+
+/*! \brief Number of Taylor terms for each accuracy */
+template <Accuracy accuracy>
+constexpr size_t num_terms(size_t full, size_t medium, size_t low) {
+  switch (accuracy) {
+    case Accuracy::Full:
+      return full;
+    case Accuracy::Medium:
+      return medium;
+    case Accuracy::Low:
+      return low;
+  }
+  return full;
+}
+
+/*! \brief Round to nearest integer
+ *
+ * Adding and subtracting 1.5*2^52 rounds to nearest. Valid for
+ * |x| < 2^51.
+ */
+UTIL_SIMD_INLINE double round_nearest(double x) {
+  constexpr double round_magic = 0x1.8p52;
+  return (x + round_magic) - round_magic;
+}
+
+/*! \brief exp(x) split into 2^n and exp(r) with |r| <= log(2)/2
+ *
+ * Returns 2^n and r. x must be within the normal range of 2^n.
+ */
+UTIL_SIMD_INLINE std::pair<double, double> exp_reduce(double x) {
+  // Note: Low bits of x/log(2)+1.5*2^52 hold n in two's complement.
+  constexpr double round_magic = 0x1.8p52;
+  constexpr double log2_e = std::numbers::log2e;
+  constexpr double log_2_hi = 0x1.62e42fee00000p-1;
+  constexpr double log_2_lo = 0x1.a39ef35793c76p-33;
+  const double shifted = x * log2_e + round_magic;
+  const double n = shifted - round_magic;
+  const double r = (x - n * log_2_hi) - n * log_2_lo;
+  const uint64_t n_bits = std::bit_cast<uint64_t>(shifted) << 52;
+  const double scale = std::bit_cast<double>(n_bits + (uint64_t{1023} << 52));
+  return {scale, r};
+}
+
+/*! \brief Clamp to interval
+ *
+ * Unlike std::fmin and std::fmax, this can be vectorized on x86.
+ */
+UTIL_SIMD_INLINE double clamp(double x, double lower, double upper) {
+  const double x_lower = x < lower ? lower : x;
+  return x_lower > upper ? upper : x_lower;
+}
+
+/*! \brief Bounds for exp with normal results */
+inline constexpr double exp_max = 709.7;
+inline constexpr double exp_min = -708.3;
+
+}  // namespace impl
+
+inline Accuracy accuracy_from_string(const std::string_view& str) {
+  if (str == "full") {
+    return Accuracy::Full;
+  }
+  if (str == "medium") {
+    return Accuracy::Medium;
+  }
+  if (str == "low") {
+    return Accuracy::Low;
+  }
+  UTIL_ERROR("Unrecognized accuracy (", str,
+             "), expected full, medium, or low");
+}
+
+inline std::string_view to_string(Accuracy accuracy) {
+  switch (accuracy) {
+    case Accuracy::Full:
+      return "full";
+    case Accuracy::Medium:
+      return "medium";
+    case Accuracy::Low:
+      return "low";
+  }
+  UTIL_ERROR("Unrecognized accuracy (", static_cast<int>(accuracy), ")");
+}
+
+template <typename Func>
+inline decltype(auto) dispatch(Accuracy accuracy, Func&& func) {
+  switch (accuracy) {
+    case Accuracy::Full:
+      return func.template operator()<Accuracy::Full>();
+    case Accuracy::Medium:
+      return func.template operator()<Accuracy::Medium>();
+    case Accuracy::Low:
+      return func.template operator()<Accuracy::Low>();
+  }
+  UTIL_ERROR("Unrecognized accuracy (", static_cast<int>(accuracy), ")");
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double cos_cycles(double x) {
+  // Reduce to r in [0,1/2] with cos(2*pi*x) = cos(2*pi*r)
+  const double r = std::abs(x - impl::round_nearest(x));
+
+  // Reduce to a in [0,1/4] with cos(2*pi*r) = sign*cos(2*pi*a)
+  const bool flip = r > 0.25;
+  const double a = flip ? 0.5 - r : r;
+
+  // Evaluate cos(2*pi*a) directly for a<=1/8, otherwise as
+  // sin(2*pi*(1/4-a))
+  // Note: Angle is in [0,pi/4]. Full accuracy truncates Taylor
+  // series at degree 16 (cos) and 15 (sin).
+  constexpr size_t num_cos_terms = impl::num_terms<accuracy>(9, 5, 4);
+  constexpr size_t num_sin_terms = impl::num_terms<accuracy>(8, 5, 3);
+  constexpr auto cos_coeffs =
+      impl::taylor_coefficients<num_cos_terms>(0, 2, true);
+  constexpr auto sin_coeffs =
+      impl::taylor_coefficients<num_sin_terms>(1, 2, true);
+  constexpr double two_pi = 2 * std::numbers::pi;
+  const bool use_sin = a > 0.125;
+  const double y = two_pi * (use_sin ? 0.25 - a : a);
+  const double y2 = y * y;
+  const double result = use_sin ? y * impl::horner(sin_coeffs, y2)
+                                : impl::horner(cos_coeffs, y2);
+  return flip ? -result : result;
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double cos(double x) {
+  constexpr double inv_two_pi = 0.5 * std::numbers::inv_pi;
+  return cos_cycles<accuracy>(x * inv_two_pi);
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double exp(double x) {
+  // Note: |r| <= log(2)/2. Full accuracy truncates Taylor series at
+  // degree 13.
+  constexpr size_t num_exp_terms = impl::num_terms<accuracy>(14, 8, 5);
+  constexpr auto coeffs =
+      impl::taylor_coefficients<num_exp_terms>(0, 1, false);
+  const double x_clamped = impl::clamp(x, impl::exp_min, impl::exp_max);
+  const auto [scale, r] = impl::exp_reduce(x_clamped);
+  const double result = scale * impl::horner(coeffs, r);
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  return x > impl::exp_max ? inf : (x < impl::exp_min ? 0 : result);
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double expm1(double x) {
+  // Taylor series without constant term near zero to avoid
+  // cancellation
+  constexpr size_t num_exp_terms = impl::num_terms<accuracy>(14, 8, 5);
+  constexpr auto coeffs =
+      impl::taylor_coefficients<num_exp_terms - 1>(1, 1, false);
+  constexpr double small = 0.5 * std::numbers::ln2;
+  const double x_small = impl::clamp(x, -small, small);
+  const double small_result = x_small * impl::horner(coeffs, x_small);
+  const double large_result = exp<accuracy>(x) - 1;
+  return std::abs(x) <= small ? small_result : large_result;
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double acos(double x) {
+  if constexpr (accuracy == Accuracy::Full) {
+    return std::acos(x);
+  } else {
+    // acos(x) = sqrt(1-x)*p(x) for x in [0,1], and
+    // acos(-x) = pi-acos(x)
+    const double a = impl::clamp(std::abs(x), 0, 1);
+    double p;
+    if constexpr (accuracy == Accuracy::Medium) {
+      // Abramowitz and Stegun 4.4.46, error <= 2e-8
+      constexpr std::array<double, 8> coeffs = {
+          1.5707963050,  -0.2145988016, 0.0889789874, -0.0501743046,
+          0.0308918810,  -0.0170881256, 0.0066700901, -0.0012624911};
+      p = impl::horner(coeffs, a);
+    } else {
+      // Abramowitz and Stegun 4.4.45, error <= 7e-5
+      constexpr std::array<double, 4> coeffs = {1.5707288, -0.2121144,
+                                                0.0742610, -0.0187293};
+      p = impl::horner(coeffs, a);
+    }
+    const double result = std::sqrt(1 - a) * p;
+    return x < 0 ? std::numbers::pi - result : result;
+  }
+}
+
+template <Accuracy accuracy>
+UTIL_SIMD_INLINE double sigmoid(double x) {
+  const double exp_x = exp<accuracy>(-std::abs(x));
+  const double numerator = x > 0 ? 1 : exp_x;
+  return numerator / (1 + exp_x);
+}
+
+}  // namespace simd_math
+}  // namespace util
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+namespace util {
+namespace nufft {
+
+/*! \brief Add sum of cosines at nonuniform points
+ *
+ * Adds sum_j amplitudes[j]*cos(2*pi*(frequencies[j]*x+phases[j])) to
+ * out at each point x, with nonuniform frequencies and points (a
+ * type-3 non-uniform FFT). Terms are spread onto a uniform frequency
+ * grid with a Gaussian kernel, as in Greengard and Lee,
+ * "Accelerating the Nonuniform Fast Fourier Transform" (2004), and
+ * the grid is summed at each point and deconvolved. The error is
+ * within about tolerance times the sum of |amplitudes|.
+ */
+void add_cosine_sum(std::span<const double> frequencies,
+                    std::span<const double> phases,
+                    std::span<const double> amplitudes,
+                    std::span<const double> points, std::span<double> out,
+                    double tolerance);
+
+/*! \brief Estimated cost of add_cosine_sum relative to direct sum
+ *
+ * Less than 1 if add_cosine_sum is expected to be faster than
+ * evaluating every cosine at every point. Spreading is linear in the
+ * number of terms, and summing the grid is linear in the number of
+ * points times the grid size, which is proportional to the frequency
+ * range times the point range.
+ */
+double relative_cost(size_t num_terms, size_t num_points, double max_frequency,
+                     double point_range, double tolerance);
+
+}  // namespace nufft
+}  // namespace util
+
+// Implementation
+#include "util/impl/nufft.hpp"
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string_view>
+
+namespace util {
+namespace simd_math {
+
+/*! \brief Accuracy of approximate math functions
+ *
+ * Full is within a few ulps of the exact value, Medium within about
+ * 1e-7, and Low within about 1e-4. The cheaper tiers are intended
+ * for interactive preview.
+ */
+enum class Accuracy { Full, Medium, Low };
+
+Accuracy accuracy_from_string(const std::string_view& str);
+std::string_view to_string(Accuracy accuracy);
+
+/*! \brief Call function template with accuracy as template argument
+ *
+ * Calls func.template operator()<accuracy>(), so that a runtime
+ * choice of accuracy is made once outside of a SIMD loop.
+ */
+template <typename Func>
+decltype(auto) dispatch(Accuracy accuracy, Func&& func);
+
+// Elementwise functions
+//
+// These are branch-free and inline, so loops over them can be
+// vectorized with "#pragma omp simd". Subnormal results are flushed
+// to zero.
+
+/*! \brief Cosine of angle in cycles, i.e. cos(2*pi*x)
+ *
+ * The angle is reduced exactly, so this is more accurate than cos
+ * for large arguments. Valid for |x| < 2^51.
+ */
+template <Accuracy accuracy = Accuracy::Full>
+double cos_cycles(double x);
+
+/*! \brief Cosine of angle in radians
+ *
+ * Absolute error grows like 1e-16*|x| from argument reduction.
+ */
+template <Accuracy accuracy = Accuracy::Full>
+double cos(double x);
+
+template <Accuracy accuracy = Accuracy::Full>
+double exp(double x);
+
+template <Accuracy accuracy = Accuracy::Full>
+double expm1(double x);
+
+/*! \brief Inverse cosine
+ *
+ * Full accuracy is std::acos, which is not vectorized. Other tiers
+ * use polynomial approximations from Abramowitz and Stegun
+ * (4.4.45-46).
+ */
+template <Accuracy accuracy = Accuracy::Full>
+double acos(double x);
+
+/*! \brief Logistic function, also known as a sigmoid function */
+template <Accuracy accuracy = Accuracy::Full>
+double sigmoid(double x);
+
+}  // namespace simd_math
+}  // namespace util
+
+// Implementation
+#include "util/impl/simd_math.hpp"
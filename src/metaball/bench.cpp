@@ -0,0 +1,199 @@
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "metaball/bench.hpp"
+#include "metaball/camera.hpp"
+#include "metaball/commands.hpp"
+#include "metaball/integrator.hpp"
+#include "metaball/random.hpp"
+#include "metaball/scene.hpp"
+#include "util/environment.hpp"
+#include "util/error.hpp"
+
+namespace {
+
+using metaball::Camera;
+using metaball::Integrator;
+using metaball::Scene;
+using metaball::SceneElement;
+using metaball::bench::element_configs;
+using metaball::bench::measure_seconds;
+using metaball::bench::random_seed;
+using metaball::bench::scene_presets;
+using ScalarType = Scene::ScalarType;
+using VectorType = Scene::VectorType;
+
+/*! \brief Prevent compiler from optimizing away benchmark results */
+volatile ScalarType sink;
+
+void print_row(const std::string_view& name, double value,
+               const std::string_view& unit) {
+  std::cout << "  " << std::left << std::setw(44) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(2) << value
+            << " " << unit << "\n"
+            << std::flush;
+}
+
+/*! \brief Time per scene element evaluation */
+void bench_elements(double min_seconds) {
+  std::cout << "SceneElement::operator()\n";
+  metaball::random::seed(random_seed);
+  std::vector<VectorType> positions(1024);
+  for (auto& position : positions) {
+    position = 2 * metaball::random::randn<VectorType>();
+  }
+  for (const auto& config : element_configs) {
+    metaball::random::seed(random_seed);
+    const auto element = SceneElement::make_element(config);
+    const auto seconds = measure_seconds(
+        [&] {
+          ScalarType result = 0;
+          for (const auto& position : positions) {
+            result += (*element)(position);
+          }
+          sink = result;
+        },
+        min_seconds);
+    print_row(config, 1e9 * seconds / positions.size(), "ns/eval");
+  }
+  std::cout << "\n";
+
+  std::cout << "SceneElement::evaluate (batch of " << positions.size()
+            << ")\n";
+  std::vector<ScalarType> values(positions.size());
+  for (const auto& config : element_configs) {
+    metaball::random::seed(random_seed);
+    const auto element = SceneElement::make_element(config);
+    const auto seconds = measure_seconds(
+        [&] {
+          element->evaluate(positions, values, false);
+          sink = values.back();
+        },
+        min_seconds);
+    print_row(config, 1e9 * seconds / positions.size(), "ns/eval");
+  }
+  std::cout << "\n";
+}
+
+/*! \brief Time per ray with each integrator */
+void bench_trace_ray(double min_seconds) {
+  std::cout << "Scene::trace_ray (smooth blobs scene)\n";
+  const std::vector<std::string> configs = {
+      "grid = 64",
+      "trapezoid = 64",
+      "monte carlo = 64",
+      "monte carlo = 64, antithetic",
+      "monte carlo = 32, control variate",
+      "stratified sampling = 64",
+      "importance sampling = 64",
+      "importance sampling = 64, antithetic",
+      "importance sampling = 32, control variate",
+      "qmc = 16",
+      "adaptive = 1e-3",
+      "gauss laguerre = 16",
+      "clenshaw curtis = 16",
+      "crossing = 16",
+  };
+  Scene scene;
+  std::unique_ptr<Integrator> integrator;
+  Camera camera;
+  metaball::random::seed(random_seed);
+  metaball::run_render_commands(scene_presets[0].second, scene, integrator,
+                                camera);
+  constexpr size_t rays_per_side = 16;
+  std::vector<VectorType> orientations;
+  for (size_t i = 0; i < rays_per_side; ++i) {
+    for (size_t j = 0; j < rays_per_side; ++j) {
+      orientations.emplace_back(
+          camera.pixel_orientation(i, j, rays_per_side, rays_per_side));
+    }
+  }
+  const auto origin = camera.aperture_position();
+  for (const auto& config : configs) {
+    integrator = Integrator::make_integrator(config);
+    const auto plan = Scene::make_integration_plan(*integrator);
+    const auto seconds = measure_seconds(
+        [&] {
+          ScalarType result = 0;
+          for (const auto& orientation : orientations) {
+            result += plan ? scene.trace_ray(origin, orientation, *plan)
+                           : scene.trace_ray(origin, orientation, *integrator);
+          }
+          sink = result;
+        },
+        min_seconds);
+    print_row(config, 1e9 * seconds / orientations.size(), "ns/ray");
+  }
+  std::cout << "\n";
+}
+
+/*! \brief Full frame throughput */
+void bench_frames(double min_seconds) {
+  const std::vector<size_t> resolutions = {128, 256, 512};
+  const int max_threads = omp_get_max_threads();
+  std::vector<int> thread_counts;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+  for (const auto& [preset_name, preset_commands] : scene_presets) {
+    std::cout << "Camera::make_image (" << preset_name << " scene)\n";
+    Scene scene;
+    std::unique_ptr<Integrator> integrator;
+    Camera camera;
+    metaball::random::seed(random_seed);
+    metaball::run_render_commands(preset_commands, scene, integrator, camera);
+    for (const auto& resolution : resolutions) {
+      for (const auto& threads : thread_counts) {
+        omp_set_num_threads(threads);
+        const auto seconds = measure_seconds(
+            [&] {
+              const auto image =
+                  camera.make_image(scene, *integrator, resolution, resolution);
+              sink = image.get(0, 0)[0];
+            },
+            min_seconds);
+        const auto name = util::concat_strings(resolution, "x", resolution,
+                                               ", ", threads, " threads");
+        print_row(name, resolution * resolution / seconds / 1e6, "Mpixel/s");
+      }
+    }
+    omp_set_num_threads(max_threads);
+    std::cout << "\n";
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  // Minimum run time for each measurement
+  const auto min_seconds =
+      util::getenv<double>("METABALL_BENCH_MIN_SECONDS", 0.25);
+
+  // Optionally run a single benchmark group
+  const std::string_view group = argc > 1 ? argv[1] : "";
+  UTIL_CHECK(group.empty() || group == "element" || group == "trace_ray" ||
+                 group == "frame",
+             "Unrecognized benchmark group (", group,
+             "), expected element, trace_ray, or frame");
+
+  if (group.empty() || group == "element") {
+    bench_elements(min_seconds);
+  }
+  if (group.empty() || group == "trace_ray") {
+    bench_trace_ray(min_seconds);
+  }
+  if (group.empty() || group == "frame") {
+    bench_frames(min_seconds);
+  }
+  return 0;
+}
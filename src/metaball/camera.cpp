@@ -8,6 +8,7 @@
 #include <string_view>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "metaball/image.hpp"
 #include "metaball/integrator.hpp"
@@ -49,6 +50,34 @@ inline Camera::ScalarType gamma_transfer_function(
   return std::pow(intensity, reciprocal_gamma);
 }
 
+/*! @brief Number of froxel corners along image axis with n pixels
+ *
+ * Corners are at multiples of size and at the last pixel.
+ */
+size_t num_froxel_corners(size_t n, size_t size) {
+  return (n - 1) / size + 1 + ((n - 1) % size != 0 ? 1 : 0);
+}
+
+/*! @brief Index of froxel corner at pixel i */
+size_t froxel_corner(size_t i, size_t n, size_t size) {
+  return i == n - 1 ? num_froxel_corners(n, size) - 1 : i / size;
+}
+
+/*! @brief Largest level up to max_level with a froxel corner at pixel i
+ *
+ * Froxels at level l are 2^l pixels wide.
+ */
+size_t froxel_level(size_t i, size_t n, size_t max_level) {
+  if (i == n - 1) {
+    return max_level;
+  }
+  size_t level = 0;
+  while (level < max_level && i % (size_t{2} << level) == 0) {
+    ++level;
+  }
+  return level;
+}
+
 }  // namespace
 
 Camera::Camera() {
@@ -60,18 +89,160 @@ Camera::Camera() {
 
 Image Camera::make_image(const Scene& scene, const Integrator& integrator,
                          size_t height, size_t width) const {
+  const auto plan = Scene::make_integration_plan(integrator);
+  if (plan && froxel_width_ > 0) {
+    return make_froxel_image(scene, *plan, height, width);
+  }
   Image result(height, width);
   const auto corner_pixel_and_offsets_ =
       corner_pixel_and_offsets(height, width);
   const auto& corner_pixel = corner_pixel_and_offsets_[0];
   const auto& shift_x = corner_pixel_and_offsets_[1];
   const auto& shift_y = corner_pixel_and_offsets_[2];
+  const auto pixel_spacing = shift_x.norm();
 #pragma omp parallel for
   for (size_t i = 0; i < height; ++i) {
     for (size_t j = 0; j < width; ++j) {
       auto pixel = corner_pixel + i * shift_y + j * shift_x;
       auto ray = aperture_position_ - pixel;
-      auto intensity = scene.trace_ray(aperture_position_, ray, integrator);
+
+      // Width of pixel per unit depth along ray
+      const auto footprint = pixel_spacing / ray.norm();
+
+      auto intensity =
+          plan ? scene.trace_ray(aperture_position_, ray, *plan, footprint)
+               : scene.trace_ray(aperture_position_, ray, integrator,
+                                 footprint);
+      result.set(i, j, gamma_transfer_function(intensity * film_speed_));
+    }
+  }
+  return result;
+}
+
+Image Camera::make_froxel_image(const Scene& scene,
+                                const Scene::IntegrationPlan& plan,
+                                size_t height, size_t width) const {
+  Image result(height, width);
+  const auto [corner_pixel, shift_x, shift_y] =
+      corner_pixel_and_offsets(height, width);
+  const auto pixel_spacing = shift_x.norm();
+  const size_t num_nodes = plan.depths.size();
+
+  // Froxel width of each node, in pixels
+  // Note: Rays diverge fastest at the image center, where neighboring
+  // rays at depth x are pixel_spacing*x/focal_length apart. Froxel
+  // widths are powers of 2, so that froxel corners at each width are
+  // also corners at smaller widths.
+  std::vector<size_t> froxel_sizes(num_nodes, 1);
+  size_t max_level = 0;
+  for (size_t k = 0; k < num_nodes; ++k) {
+    const auto ray_spacing = pixel_spacing * plan.depths[k] / focal_length_;
+    const auto max_size = froxel_width_ / ray_spacing;
+    size_t level = 0;
+    while ((size_t{2} << level) <= max_froxel_size &&
+           (size_t{2} << level) <= max_size) {
+      ++level;
+    }
+    froxel_sizes[k] = size_t{1} << level;
+    max_level = std::max(max_level, level);
+  }
+
+  // Nodes sampled by rays at each level
+  // Note: A ray at level l passes through corners of froxels up to
+  // 2^l pixels wide, so it samples the nodes with those froxels.
+  std::vector<Scene::IntegrationPlan> plans(max_level + 1);
+  std::vector<std::vector<size_t>> plan_nodes(max_level + 1);
+  for (size_t level = 0; level <= max_level; ++level) {
+    auto& level_plan = plans[level];
+    level_plan.segment_offsets.push_back(0);
+    for (size_t s = 0; s + 1 < plan.segment_offsets.size(); ++s) {
+      for (size_t k = plan.segment_offsets[s]; k < plan.segment_offsets[s + 1];
+           ++k) {
+        if (froxel_sizes[k] <= (size_t{1} << level)) {
+          level_plan.depths.push_back(plan.depths[k]);
+          level_plan.weights.push_back(plan.weights[k]);
+          plan_nodes[level].push_back(k);
+        }
+      }
+      level_plan.segment_offsets.push_back(level_plan.depths.size());
+    }
+  }
+
+  // Froxel grid of each node with froxels wider than a pixel
+  std::vector<size_t> froxel_offsets(num_nodes + 1, 0);
+  for (size_t k = 0; k < num_nodes; ++k) {
+    const auto size = froxel_sizes[k];
+    const auto num_corners = size == 1
+                                 ? 0
+                                 : num_froxel_corners(height, size) *
+                                       num_froxel_corners(width, size);
+    froxel_offsets[k + 1] = froxel_offsets[k] + num_corners;
+  }
+  std::vector<ScalarType> froxels(froxel_offsets.back());
+
+  // Trace rays, summing densities at nodes with one froxel per pixel
+  // and storing densities at froxel corners
+  std::vector<ScalarType> intensities(height * width);
+#pragma omp parallel for
+  for (size_t i = 0; i < height; ++i) {
+    std::vector<ScalarType> densities;
+    const auto row_level = froxel_level(i, height, max_level);
+    for (size_t j = 0; j < width; ++j) {
+      const auto pixel = corner_pixel + i * shift_y + j * shift_x;
+      const auto ray = aperture_position_ - pixel;
+      const auto footprint = pixel_spacing / ray.norm();
+      const auto level =
+          std::min(row_level, froxel_level(j, width, max_level));
+      const auto& nodes = plan_nodes[level];
+      densities.resize(nodes.size());
+      scene.sample_ray(aperture_position_, ray, plans[level], densities,
+                       footprint);
+      ScalarType intensity = 0;
+      for (size_t n = 0; n < nodes.size(); ++n) {
+        const auto k = nodes[n];
+        const auto size = froxel_sizes[k];
+        if (size == 1) {
+          intensity += plan.weights[k] * densities[n];
+        } else {
+          const auto row = froxel_corner(i, height, size);
+          const auto col = froxel_corner(j, width, size);
+          froxels[froxel_offsets[k] + row * num_froxel_corners(width, size) +
+                  col] = densities[n];
+        }
+      }
+      intensities[i * width + j] = intensity;
+    }
+  }
+
+  // Interpolate froxels
+#pragma omp parallel for
+  for (size_t i = 0; i < height; ++i) {
+    for (size_t j = 0; j < width; ++j) {
+      auto intensity = intensities[i * width + j];
+      for (size_t k = 0; k < num_nodes; ++k) {
+        const auto size = froxel_sizes[k];
+        if (size == 1) {
+          continue;
+        }
+        const auto i0 = i / size * size;
+        const auto j0 = j / size * size;
+        const auto i1 = std::min(i0 + size, height - 1);
+        const auto j1 = std::min(j0 + size, width - 1);
+        const auto row0 = froxel_corner(i0, height, size);
+        const auto col0 = froxel_corner(j0, width, size);
+        const auto row1 = froxel_corner(i1, height, size);
+        const auto col1 = froxel_corner(j1, width, size);
+        const ScalarType a = i1 > i0 ? ScalarType(i - i0) / (i1 - i0) : 0;
+        const ScalarType b = j1 > j0 ? ScalarType(j - j0) / (j1 - j0) : 0;
+        const auto num_cols = num_froxel_corners(width, size);
+        const auto* grid = &froxels[froxel_offsets[k]];
+        const auto density =
+            (1 - a) * ((1 - b) * grid[row0 * num_cols + col0] +
+                       b * grid[row0 * num_cols + col1]) +
+            a * ((1 - b) * grid[row1 * num_cols + col0] +
+                 b * grid[row1 * num_cols + col1]);
+        intensity += plan.weights[k] * density;
+      }
       result.set(i, j, gamma_transfer_function(intensity * film_speed_));
     }
   }
@@ -96,6 +267,8 @@ Camera::ScalarType Camera::focal_length() const { return focal_length_; }
 
 Camera::ScalarType Camera::film_speed() const { return film_speed_; }
 
+Camera::ScalarType Camera::froxel_width() const { return froxel_width_; }
+
 void Camera::set_aperture_position(const VectorType& position) {
   aperture_position_ = position;
 }
@@ -130,6 +303,11 @@ void Camera::set_film_speed(const ScalarType& film_speed) {
   film_speed_ = film_speed;
 }
 
+void Camera::set_froxel_width(const ScalarType& width) {
+  UTIL_CHECK(width >= 0, "Froxel width must be non-negative, but got ", width);
+  froxel_width_ = width;
+}
+
 void Camera::set_orientation(const VectorType& aperture_orientation,
                              const VectorType& row_orientation,
                              const VectorType& column_orientation) {
@@ -0,0 +1,168 @@
+#include "metaball/commands.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "metaball/camera.hpp"
+#include "metaball/integrator.hpp"
+#include "metaball/random.hpp"
+#include "metaball/scene.hpp"
+#include "util/error.hpp"
+#include "util/simd_math.hpp"
+#include "util/string.hpp"
+
+namespace metaball {
+
+std::vector<std::pair<std::string_view, std::string_view>> parse_commands(
+    const std::string_view& line) {
+  std::vector<std::pair<std::string_view, std::string_view>> result;
+  for (const auto& unparsed_command : util::split(line, ";")) {
+    const auto command = util::split(unparsed_command, "=", 2);
+    UTIL_CHECK(command.size() >= 1, "error parsing command (", unparsed_command,
+               ")");
+    UTIL_CHECK(command.size() <= 2, "error parsing command (", unparsed_command,
+               ")");
+    const auto& name = util::strip(command[0]);
+    const auto& params = command.size() > 1 ? util::strip(command[1]) : "";
+    result.emplace_back(name, params);
+  }
+  return result;
+}
+
+bool run_render_command(const std::string_view& name,
+                        const std::string_view& params, Scene& scene,
+                        std::unique_ptr<Integrator>& integrator,
+                        Camera& camera) {
+  using ScalarType = Scene::ScalarType;
+
+  // Random number generator commands
+  if (name == "seed") {
+    random::seed(util::from_string<uint32_t>(params));
+    return true;
+  }
+
+  // Camera commands
+  if (name == "reset camera") {
+    camera = {};
+    return true;
+  }
+  if (name == "focal length") {
+    camera.set_focal_length(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "film speed") {
+    camera.set_film_speed(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "froxel width") {
+    camera.set_froxel_width(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (Camera::is_adjust_shot_type(name)) {
+    camera.adjust_shot(name, util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "random orientation") {
+    camera.set_orientation(random::randn<Camera::VectorType>(),
+                           random::randn<Camera::VectorType>(),
+                           random::randn<Camera::VectorType>());
+    return true;
+  }
+
+  // Scene commands
+  if (name == "reset scene") {
+    scene = {};
+    return true;
+  }
+  if (name == "add scene") {
+    scene.add_element(SceneElement::make_element(params));
+    return true;
+  }
+  if (name == "remove scene") {
+    size_t idx = 0;
+    if (params.empty()) {
+      if (scene.num_elements() > 0) {
+        idx = scene.num_elements() - 1;
+      }
+    } else {
+      idx = util::from_string<size_t>(params);
+    }
+    scene.remove_element(idx);
+    return true;
+  }
+  if (name == "delete scene") {
+    if (params.empty()) {
+      if (scene.num_elements() > 0) {
+        scene.remove_element(scene.num_elements() - 1);
+      }
+    } else {
+      scene.remove_element(util::from_string<size_t>(params));
+    }
+    return true;
+  }
+  if (name == "density threshold") {
+    scene.set_density_threshold(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "density threshold width") {
+    scene.set_density_threshold_width(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "math accuracy") {
+    scene.set_math_accuracy(util::simd_math::accuracy_from_string(params));
+    return true;
+  }
+  if (name == "far field theta") {
+    scene.set_far_field_theta(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "nufft tolerance") {
+    scene.set_nufft_tolerance(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "frequency lod") {
+    UTIL_CHECK(params == "on" || params == "off",
+               "Invalid frequency LOD mode (", params, "), expected on or off");
+    scene.set_frequency_lod(params == "on");
+    return true;
+  }
+  if (name == "density cache spacing") {
+    scene.set_density_cache_spacing(util::from_string<ScalarType>(params));
+    return true;
+  }
+  if (name == "jit") {
+    // Note: "jit = wait" blocks until the kernel for the current
+    // scene is built, e.g. before timing an offline render.
+    if (params == "wait") {
+      scene.wait_for_jit();
+      return true;
+    }
+    UTIL_CHECK(params == "on" || params == "off", "Invalid JIT mode (",
+               params, "), expected on, off, or wait");
+    scene.set_jit_enabled(params == "on");
+    return true;
+  }
+  if (name == "set integrator") {
+    integrator = Integrator::make_integrator(params);
+    return true;
+  }
+
+  return false;
+}
+
+void run_render_commands(const std::string_view& line, Scene& scene,
+                         std::unique_ptr<Integrator>& integrator,
+                         Camera& camera) {
+  for (const auto& [name, params] : parse_commands(line)) {
+    if (name == "") {
+      continue;
+    }
+    UTIL_CHECK(run_render_command(name, params, scene, integrator, camera),
+               "Unrecognized command: ", name);
+  }
+}
+
+}  // namespace metaball
@@ -1,10 +1,15 @@
 #include "metaball/image.hpp"
 
-#include <QColor>
-#include <QImage>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "util/error.hpp"
+
 namespace metaball {
 
 Image::Image(size_t height, size_t width)
@@ -28,22 +33,15 @@ std::array<Image::DataType, 3> Image::get(size_t i, size_t j) const {
   return {data_[offset], data_[offset + 1], data_[offset + 2]};
 }
 
-Image::operator QImage() const {
-  QImage result(width_, height_, QImage::Format_RGB32);
-  for (size_t i = 0; i < height_; ++i) {
-    for (size_t j = 0; j < width_; ++j) {
-      const size_t offset = (i * width_ + j) * 3;
-      constexpr DataType min = 0;
-      constexpr DataType max = 255;
-      const auto r = std::clamp(256 * data_[offset], min, max);
-      const auto g = std::clamp(256 * data_[offset + 1], min, max);
-      const auto b = std::clamp(256 * data_[offset + 2], min, max);
-      const auto color =
-          qRgb(static_cast<int>(r), static_cast<int>(g), static_cast<int>(b));
-      result.setPixel(j, i, color);
-    }
-  }
-  return result;
+std::array<uint8_t, 3> Image::get_8bit(size_t i, size_t j) const {
+  const size_t offset = (i * width_ + j) * 3;
+  constexpr DataType min = 0;
+  constexpr DataType max = 255;
+  const auto r = std::clamp(256 * data_[offset], min, max);
+  const auto g = std::clamp(256 * data_[offset + 1], min, max);
+  const auto b = std::clamp(256 * data_[offset + 2], min, max);
+  return {static_cast<uint8_t>(r), static_cast<uint8_t>(g),
+          static_cast<uint8_t>(b)};
 }
 
 void Image::normalize() {
@@ -58,4 +56,19 @@ void Image::normalize() {
   }
 }
 
+void Image::save_ppm(const std::string_view& file) const {
+  std::ofstream out(std::string(file), std::ios::binary);
+  UTIL_CHECK(out, "Failed to open image file (", file, ")");
+  out << "P6\n" << width_ << " " << height_ << "\n255\n";
+  std::vector<uint8_t> row(width_ * 3);
+  for (size_t i = 0; i < height_; ++i) {
+    for (size_t j = 0; j < width_; ++j) {
+      const auto rgb = get_8bit(i, j);
+      std::copy(rgb.begin(), rgb.end(), row.begin() + j * 3);
+    }
+    out.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+  UTIL_CHECK(out, "Failed to write image file (", file, ")");
+}
+
 }  // namespace metaball
@@ -1,16 +1,226 @@
 #include "metaball/integrator.hpp"
 
-#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <numbers>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
-#include "metaball/random.hpp"
 #include "util/error.hpp"
 #include "util/string.hpp"
 
 namespace metaball {
 
+namespace {
+
+using ScalarType = Integrator::ScalarType;
+
+/*! \brief Eigenvalues of symmetric tridiagonal matrix
+ *
+ * Implicit QL algorithm with Wilkinson shifts.
+ *
+ * \param[in] diag    Diagonal entries
+ * \param[in] subdiag Off-diagonal entries, with subdiag[i] coupling
+ *                    entries i and i+1
+ */
+std::vector<ScalarType> symmetric_tridiagonal_eigen(
+    std::vector<ScalarType> diag, std::vector<ScalarType> subdiag) {
+  const size_t n = diag.size();
+  subdiag.resize(n, 0);
+  constexpr ScalarType eps = std::numeric_limits<ScalarType>::epsilon();
+  for (size_t l = 0; l < n; ++l) {
+    for (size_t iter = 0;; ++iter) {
+      // Find small off-diagonal entry to split matrix
+      size_t m = l;
+      for (; m + 1 < n; ++m) {
+        const auto scale = std::abs(diag[m]) + std::abs(diag[m + 1]);
+        if (std::abs(subdiag[m]) <= eps * scale) {
+          break;
+        }
+      }
+      if (m == l) {
+        break;
+      }
+      UTIL_CHECK(iter < 64, "Tridiagonal eigensolver did not converge");
+
+      // QL step with implicit shift
+      auto g = (diag[l + 1] - diag[l]) / (2 * subdiag[l]);
+      auto r = std::hypot(g, static_cast<ScalarType>(1));
+      g = diag[m] - diag[l] + subdiag[l] / (g + std::copysign(r, g));
+      ScalarType s = 1, c = 1, p = 0;
+      bool underflow = false;
+      for (size_t i = m; i-- > l;) {
+        const auto f = s * subdiag[i];
+        const auto b = c * subdiag[i];
+        r = std::hypot(f, g);
+        subdiag[i + 1] = r;
+        if (r == 0) {
+          diag[i + 1] -= p;
+          subdiag[m] = 0;
+          underflow = true;
+          break;
+        }
+        s = f / r;
+        c = g / r;
+        g = diag[i + 1] - p;
+        r = (diag[i] - g) * s + 2 * c * b;
+        p = s * r;
+        diag[i + 1] = g + p;
+        g = c * r - b;
+      }
+      if (underflow) {
+        continue;
+      }
+      diag[l] -= p;
+      subdiag[l] = g;
+      subdiag[m] = 0;
+    }
+  }
+  return diag;
+}
+
+/*! \brief Log of |L_n^alpha(s)|, generalized Laguerre polynomial
+ *
+ * Evaluated with the three-term recurrence, rescaling to avoid
+ * overflow at large s.
+ */
+ScalarType log_abs_laguerre(size_t n, ScalarType alpha, ScalarType s) {
+  constexpr ScalarType rescale = 0x1p-512;
+  ScalarType prev = 1, curr = 1 + alpha - s, log_scale = 0;
+  if (n == 0) {
+    return 0;
+  }
+  for (size_t k = 1; k < n; ++k) {
+    const auto next = ((2 * k + 1 + alpha - s) * curr - (k + alpha) * prev) /
+                      static_cast<ScalarType>(k + 1);
+    prev = curr;
+    curr = next;
+    if (std::abs(curr) > 1 / rescale) {
+      prev *= rescale;
+      curr *= rescale;
+      log_scale -= std::log(rescale);
+    }
+  }
+  return std::log(std::abs(curr)) + log_scale;
+}
+
+/*! \brief Generalized Gauss-Laguerre rule with weight s^alpha*exp(-s)
+ *
+ * Nodes are on [0,inf), computed as eigenvalues of the Jacobi
+ * matrix as in Golub-Welsch. Weights are returned as their logs,
+ * since they underflow at large nodes (from about 180 nodes), and
+ * are computed from w=Gamma(n+alpha+1)/n!*s/((n+1)*L_{n+1}^alpha(s))^2
+ * rather than from eigenvectors, whose first components also
+ * underflow.
+ */
+Integrator::QuadratureRule gauss_laguerre_log_rule(size_t n,
+                                                   ScalarType alpha) {
+  // Jacobi matrix for generalized Laguerre polynomials
+  std::vector<ScalarType> diag(n), subdiag(n > 0 ? n - 1 : 0);
+  for (size_t k = 0; k < n; ++k) {
+    diag[k] = 2 * k + alpha + 1;
+  }
+  for (size_t k = 1; k < n; ++k) {
+    subdiag[k - 1] = std::sqrt(k * (k + alpha));
+  }
+
+  // Nodes are eigenvalues
+  Integrator::QuadratureRule rule;
+  rule.nodes = symmetric_tridiagonal_eigen(std::move(diag), std::move(subdiag));
+  std::sort(rule.nodes.begin(), rule.nodes.end());
+
+  // Log weights
+  const auto log_scale = std::lgamma(n + alpha + 1) - std::lgamma(n + 1) -
+                         2 * std::log(static_cast<ScalarType>(n + 1));
+  for (const auto& s : rule.nodes) {
+    rule.weights.push_back(log_scale + std::log(s) -
+                           2 * log_abs_laguerre(n + 1, alpha, s));
+  }
+  return rule;
+}
+
+/*! \brief Clenshaw-Curtis rule on unit interval
+ *
+ * Nodes are at t=(1-cos(k*pi/n))/2 for k=0,...,n.
+ */
+Integrator::QuadratureRule clenshaw_curtis_rule(size_t n) {
+  constexpr ScalarType pi = std::numbers::pi;
+  Integrator::QuadratureRule rule;
+  for (size_t k = 0; k <= n; ++k) {
+    const ScalarType theta = pi * k / n;
+    ScalarType sum = 0;
+    for (size_t j = 1; 2 * j <= n; ++j) {
+      const ScalarType b = 2 * j == n ? 1 : 2;
+      sum += b / (4 * j * j - 1) * std::cos(2 * j * theta);
+    }
+    const ScalarType c = (k == 0 || k == n) ? 1 : 2;
+    rule.nodes.push_back((1 - std::cos(theta)) / 2);
+    rule.weights.push_back(c / (2 * n) * (1 - sum));
+  }
+  return rule;
+}
+
+using VarianceReduction = Integrator::VarianceReduction;
+
+/*! \brief Parse config parameters for stochastic integrator
+ *
+ * Parameters are the number of evaluations and optionally
+ * "antithetic" or "control variate", e.g. "64, antithetic".
+ */
+std::pair<size_t, VarianceReduction> parse_sampling_params(
+    const std::string_view& params, size_t default_num_evals) {
+  const auto& params_split = util::split(params, ",");
+  UTIL_CHECK(params_split.size() <= 2, "Invalid sampling parameters (",
+             params, ")");
+  const auto& num_evals_str =
+      params_split.empty() ? "" : util::strip(params_split[0]);
+  const size_t num_evals = num_evals_str.empty()
+                               ? default_num_evals
+                               : util::from_string<size_t>(num_evals_str);
+  if (params_split.size() < 2) {
+    return {num_evals, VarianceReduction::None};
+  }
+  const auto& mode = util::strip(params_split[1]);
+  if (mode == "antithetic") {
+    return {num_evals, VarianceReduction::Antithetic};
+  }
+  if (mode == "control variate") {
+    return {num_evals, VarianceReduction::ControlVariate};
+  }
+  UTIL_ERROR("Unrecognized variance reduction (", mode, ")");
+}
+
+/*! \brief Suffix for integrator description */
+std::string describe_variance_reduction(VarianceReduction variance_reduction) {
+  switch (variance_reduction) {
+    case VarianceReduction::None:
+      return "";
+    case VarianceReduction::Antithetic:
+      return ", variance_reduction=antithetic";
+    case VarianceReduction::ControlVariate:
+      return ", variance_reduction=control variate";
+  }
+  UTIL_ERROR("Unrecognized variance reduction (",
+             static_cast<int>(variance_reduction), ")");
+}
+
+}  // namespace
+
+Integrator::Integrator(Type type) : type_{type} {}
+
+std::optional<Integrator::QuadratureRule> Integrator::quadrature_rule() const {
+  return std::nullopt;
+}
+
+std::optional<size_t> Integrator::take_num_evals() const {
+  return std::nullopt;
+}
+
 std::unique_ptr<Integrator> Integrator::make_integrator(
     const std::string_view& config) {
   const auto config_parsed = util::split(config, "=", 2);
@@ -30,40 +240,92 @@ std::unique_ptr<Integrator> Integrator::make_integrator(
     return std::make_unique<TrapezoidIntegrator>(num_evals);
   }
   if (type == "monte carlo") {
-    const size_t num_evals =
-        params.empty() ? 64 : util::from_string<size_t>(params);
-    return std::make_unique<MonteCarloIntegrator>(num_evals);
+    const auto [num_evals, variance_reduction] =
+        parse_sampling_params(params, 64);
+    return std::make_unique<MonteCarloIntegrator>(num_evals,
+                                                  variance_reduction);
   }
   if (type == "stratified sampling") {
-    const size_t num_grids =
-        params.empty() ? 64 : util::from_string<size_t>(params);
-    return std::make_unique<StratifiedSamplingIntegrator>(num_grids, 1);
+    const auto [num_grids, variance_reduction] =
+        parse_sampling_params(params, 64);
+    return std::make_unique<StratifiedSamplingIntegrator>(num_grids, 1,
+                                                          variance_reduction);
+  }
+  if (type == "importance sampling") {
+    const auto [num_evals, variance_reduction] =
+        parse_sampling_params(params, 64);
+    return std::make_unique<ImportanceSamplingIntegrator>(num_evals,
+                                                          variance_reduction);
+  }
+  if (type == "qmc" || type == "quasi monte carlo") {
+    const size_t num_evals =
+        params.empty() ? 16 : util::from_string<size_t>(params);
+    return std::make_unique<QuasiMonteCarloIntegrator>(num_evals);
+  }
+  if (type == "adaptive") {
+    const auto& params_split = util::split(params, ",");
+    const ScalarType abs_tol =
+        params.empty() ? 1e-3 : util::from_string<ScalarType>(params_split[0]);
+    const ScalarType rel_tol =
+        params_split.size() < 2
+            ? 1e-3
+            : util::from_string<ScalarType>(params_split[1]);
+    const size_t max_evals = params_split.size() < 3
+                                 ? 256
+                                 : util::from_string<size_t>(params_split[2]);
+    const size_t num_initial_intervals =
+        params_split.size() < 4 ? 4
+                                : util::from_string<size_t>(params_split[3]);
+    return std::make_unique<AdaptiveIntegrator>(abs_tol, rel_tol, max_evals,
+                                                num_initial_intervals);
+  }
+  if (type == "gauss laguerre") {
+    const size_t num_evals =
+        params.empty() ? 16 : util::from_string<size_t>(params);
+    return std::make_unique<GaussLaguerreIntegrator>(num_evals);
+  }
+  if (type == "clenshaw curtis") {
+    const size_t num_evals =
+        params.empty() ? 16 : util::from_string<size_t>(params);
+    return std::make_unique<ClenshawCurtisIntegrator>(num_evals);
+  }
+  if (type == "crossing") {
+    const auto& params_split = util::split(params, ",");
+    const size_t num_brackets =
+        params.empty() ? 16 : util::from_string<size_t>(params_split[0]);
+    const ScalarType tolerance =
+        params_split.size() < 2
+            ? 1e-6
+            : util::from_string<ScalarType>(params_split[1]);
+    return std::make_unique<CrossingIntegrator>(num_brackets, tolerance);
   }
   UTIL_ERROR("Unrecognized integrator (", type, ")");
 }
 
-GridIntegrator::GridIntegrator(size_t num_evals) : num_evals_{num_evals} {}
+GridIntegrator::GridIntegrator(size_t num_evals)
+    : Integrator(Type::Grid), num_evals_{num_evals} {
+  UTIL_CHECK(num_evals_ >= 1,
+             "Grid integration requires at least 1 evaluation point, but got ",
+             num_evals_);
+}
 
 std::string GridIntegrator::describe() const {
   return util::concat_strings("GridIntegrator (num_evals=", num_evals_, ")");
 }
 
-GridIntegrator::ScalarType GridIntegrator::operator()(
-    const std::function<ScalarType(ScalarType)>& integrand) const {
-  UTIL_CHECK(num_evals_ >= 1,
-             "Grid integration requires at least 1 evaluation point, but got ",
-             num_evals_);
+std::optional<Integrator::QuadratureRule> GridIntegrator::quadrature_rule()
+    const {
   const ScalarType half_grid_size = static_cast<ScalarType>(0.5) / num_evals_;
-  ScalarType result = 0;
+  QuadratureRule rule;
   for (size_t i = 0; i < num_evals_; ++i) {
-    result += integrand(half_grid_size * (2 * i + 1));
+    rule.nodes.push_back(half_grid_size * (2 * i + 1));
+    rule.weights.push_back(2 * half_grid_size);
   }
-  result *= 2 * half_grid_size;
-  return result;
+  return rule;
 }
 
 TrapezoidIntegrator::TrapezoidIntegrator(size_t num_evals)
-    : num_evals_{num_evals} {
+    : Integrator(Type::Trapezoid), num_evals_{num_evals} {
   UTIL_CHECK(num_evals_ >= 2,
              "Trapezoid rule requires at least 2 evaluation points, but got ",
              num_evals_);
@@ -74,61 +336,225 @@ std::string TrapezoidIntegrator::describe() const {
                               ")");
 }
 
-TrapezoidIntegrator::ScalarType TrapezoidIntegrator::operator()(
-    const std::function<ScalarType(ScalarType)>& integrand) const {
-  constexpr ScalarType zero = static_cast<ScalarType>(0);
+std::optional<Integrator::QuadratureRule>
+TrapezoidIntegrator::quadrature_rule() const {
   constexpr ScalarType one = static_cast<ScalarType>(1);
   const ScalarType grid_size = one / (num_evals_ - 1);
-  ScalarType result = integrand(zero) / 2;
-  for (size_t i = 1; i < num_evals_ - 1; ++i) {
-    result += integrand(grid_size * i);
+  QuadratureRule rule;
+  for (size_t i = 0; i < num_evals_; ++i) {
+    const bool is_endpoint = i == 0 || i == num_evals_ - 1;
+    rule.nodes.push_back(i == num_evals_ - 1 ? one : grid_size * i);
+    rule.weights.push_back(is_endpoint ? grid_size / 2 : grid_size);
   }
-  result += integrand(one) / 2;
-  result *= grid_size;
-  return result;
+  return rule;
 }
 
-MonteCarloIntegrator::MonteCarloIntegrator(size_t num_evals)
-    : num_evals_{num_evals} {}
+MonteCarloIntegrator::MonteCarloIntegrator(
+    size_t num_evals, VarianceReduction variance_reduction)
+    : Integrator(Type::MonteCarlo),
+      num_evals_{num_evals},
+      variance_reduction_{variance_reduction} {}
 
 std::string MonteCarloIntegrator::describe() const {
   return util::concat_strings("MonteCarloIntegrator (num_evals=", num_evals_,
+                              describe_variance_reduction(variance_reduction_),
                               ")");
 }
 
-MonteCarloIntegrator::ScalarType MonteCarloIntegrator::operator()(
-    const std::function<ScalarType(ScalarType)>& integrand) const {
-  ScalarType result = 0;
+StratifiedSamplingIntegrator::StratifiedSamplingIntegrator(
+    size_t num_grids, size_t evals_per_grid,
+    VarianceReduction variance_reduction)
+    : Integrator(Type::StratifiedSampling),
+      num_grids_{num_grids},
+      evals_per_grid_{evals_per_grid},
+      variance_reduction_{variance_reduction} {}
+
+std::string StratifiedSamplingIntegrator::describe() const {
+  return util::concat_strings(
+      "StratifiedSamplingIntegrator (num_grids=", num_grids_,
+      ", evals_per_grid=", evals_per_grid_,
+      describe_variance_reduction(variance_reduction_), ")");
+}
+
+GaussLaguerreIntegrator::GaussLaguerreIntegrator(size_t num_evals)
+    : Integrator(Type::GaussLaguerre), num_evals_{num_evals} {
+  UTIL_CHECK(num_evals_ >= 1,
+             "Gauss-Laguerre quadrature requires at least 1 evaluation point, "
+             "but got ",
+             num_evals_);
+
+  // Map nodes from [0,inf) to unit interval with s=t/(1-t) and
+  // divide weights by weight function and Jacobian
+  // Note: Weights are combined in log space, since the weights and
+  // the weight function both underflow at large nodes while their
+  // ratio does not.
+  const auto rule = gauss_laguerre_log_rule(num_evals_, 1);
+  ScalarType kernel_integral = 0;
   for (size_t i = 0; i < num_evals_; ++i) {
-    result += integrand(random::rand<ScalarType>());
+    const auto s = rule.nodes[i];
+    const auto log_weight = rule.weights[i];
+    const auto weight =
+        std::exp(log_weight + s - std::log(s) - 2 * std::log1p(s));
+    UTIL_CHECK(std::isfinite(weight), "Gauss-Laguerre weight ", i, " of ",
+               num_evals_, " is not finite (node ", s, ")");
+    rule_.nodes.push_back(s / (1 + s));
+    rule_.weights.push_back(weight);
+    kernel_integral += std::exp(log_weight);
   }
-  result /= num_evals_;
-  return result;
+
+  // Check that rule integrates decay kernel s*exp(-s), whose integral
+  // over [0,inf) is 1
+  UTIL_CHECK(std::abs(kernel_integral - 1) < 1e-8,
+             "Gauss-Laguerre rule with ", num_evals_,
+             " nodes integrates decay kernel to ", kernel_integral,
+             ", expected 1");
 }
 
-StratifiedSamplingIntegrator::StratifiedSamplingIntegrator(
-    size_t num_grids, size_t evals_per_grid)
-    : num_grids_{num_grids}, evals_per_grid_{evals_per_grid} {}
+std::string GaussLaguerreIntegrator::describe() const {
+  return util::concat_strings("GaussLaguerreIntegrator (num_evals=",
+                              num_evals_, ")");
+}
 
-std::string StratifiedSamplingIntegrator::describe() const {
+std::optional<Integrator::QuadratureRule>
+GaussLaguerreIntegrator::quadrature_rule() const {
+  return rule_;
+}
+
+ClenshawCurtisIntegrator::ClenshawCurtisIntegrator(size_t num_evals)
+    : Integrator(Type::ClenshawCurtis), num_evals_{num_evals} {
+  UTIL_CHECK(num_evals_ >= 1,
+             "Clenshaw-Curtis quadrature requires at least 1 evaluation "
+             "point, but got ",
+             num_evals_);
+  rule_ = clenshaw_curtis_rule(num_evals_ + 1);
+}
+
+std::string ClenshawCurtisIntegrator::describe() const {
+  return util::concat_strings("ClenshawCurtisIntegrator (num_evals=",
+                              num_evals_, ")");
+}
+
+std::optional<Integrator::QuadratureRule>
+ClenshawCurtisIntegrator::quadrature_rule() const {
+  return rule_;
+}
+
+ImportanceSamplingIntegrator::ImportanceSamplingIntegrator(
+    size_t num_evals, VarianceReduction variance_reduction)
+    : Integrator(Type::ImportanceSampling),
+      num_evals_{num_evals},
+      variance_reduction_{variance_reduction} {
+  UTIL_CHECK(num_evals_ >= 1,
+             "Importance sampling requires at least 1 evaluation point, but "
+             "got ",
+             num_evals_);
+}
+
+std::string ImportanceSamplingIntegrator::describe() const {
+  return util::concat_strings("ImportanceSamplingIntegrator (num_evals=",
+                              num_evals_,
+                              describe_variance_reduction(variance_reduction_),
+                              ")");
+}
+
+std::pair<ImportanceSamplingIntegrator::ScalarType,
+          ImportanceSamplingIntegrator::ScalarType>
+ImportanceSamplingIntegrator::sample(const ScalarType& u) {
+  // Invert CDF of Gamma(2) distribution, 1-(1+s)*exp(-s) = u, by
+  // solving s-log(1+s) = -log(1-u). The initial guess is from
+  // small-s and large-s expansions, and two Halley iterations reduce
+  // the relative CDF error below 1e-10.
+  const auto target = -std::log1p(-u);
+  if (!(target > 0)) {
+    return {0, 0};
+  }
+  auto s = target < 1.5 ? std::sqrt(2 * target) + 2 * target / 3
+                        : target + std::log1p(target + std::log1p(target));
+  for (size_t iter = 0; iter < 2; ++iter) {
+    const auto h = s - std::log1p(s) - target;
+    const auto dh = s / (1 + s);
+    const auto d2h = 1 / ((1 + s) * (1 + s));
+    s -= 2 * h * dh / (2 * dh * dh - h * d2h);
+  }
+
+  // Map to unit interval with t=s/(1+s)
+  const auto t = s / (1 + s);
+  const auto pdf = s * std::exp(-s) * (1 + s) * (1 + s);
+  return {t, pdf};
+}
+
+QuasiMonteCarloIntegrator::QuasiMonteCarloIntegrator(size_t num_evals)
+    : Integrator(Type::QuasiMonteCarlo), num_evals_{num_evals} {
+  UTIL_CHECK(num_evals_ >= 1,
+             "Quasi-Monte Carlo integration requires at least 1 evaluation "
+             "point, but got ",
+             num_evals_);
+}
+
+std::string QuasiMonteCarloIntegrator::describe() const {
+  return util::concat_strings("QuasiMonteCarloIntegrator (num_evals=",
+                              num_evals_, ")");
+}
+
+AdaptiveIntegrator::AdaptiveIntegrator(ScalarType abs_tol, ScalarType rel_tol,
+                                       size_t max_evals,
+                                       size_t num_initial_intervals)
+    : Integrator(Type::Adaptive),
+      abs_tol_{abs_tol},
+      rel_tol_{rel_tol},
+      max_evals_{max_evals},
+      num_initial_intervals_{num_initial_intervals} {
+  UTIL_CHECK(num_initial_intervals_ >= 1,
+             "Adaptive integration requires at least 1 initial interval");
+  UTIL_CHECK(abs_tol_ >= 0, "Invalid absolute tolerance (", abs_tol_, ")");
+  UTIL_CHECK(rel_tol_ >= 0, "Invalid relative tolerance (", rel_tol_, ")");
+  UTIL_CHECK(abs_tol_ > 0 || rel_tol_ > 0,
+             "Adaptive integration requires a positive tolerance");
+
+  // Skip kernel tail with mass below half of absolute tolerance
+  tail_bound_ = std::min(abs_tol_ / 2, static_cast<ScalarType>(1));
+  tail_cutoff_ = 1 - tail_bound_;
+}
+
+std::string AdaptiveIntegrator::describe() const {
   return util::concat_strings(
-      "StratifiedSamplingIntegrator (num_grids=", num_grids_,
-      ", evals_per_grid=", evals_per_grid_, ")");
-}
-
-StratifiedSamplingIntegrator::ScalarType
-StratifiedSamplingIntegrator::operator()(
-    const std::function<ScalarType(ScalarType)>& integrand) const {
-  const ScalarType grid_size = static_cast<ScalarType>(1) / num_grids_;
-  ScalarType result = 0;
-  for (size_t i = 0; i < num_grids_; ++i) {
-    const ScalarType offset = grid_size * i;
-    for (size_t j = 0; j < evals_per_grid_; ++j) {
-      result += integrand(offset + grid_size * random::rand<ScalarType>());
-    }
+      "AdaptiveIntegrator (abs_tol=", abs_tol_, ", rel_tol=", rel_tol_,
+      ", max_evals=", max_evals_,
+      ", num_initial_intervals=", num_initial_intervals_, ")");
+}
+
+std::optional<size_t> AdaptiveIntegrator::take_num_evals() const {
+  return num_evals_.exchange(0, std::memory_order_relaxed);
+}
+
+CrossingIntegrator::CrossingIntegrator(size_t num_brackets,
+                                       ScalarType tolerance)
+    : Integrator(Type::Crossing),
+      num_brackets_{num_brackets},
+      tolerance_{tolerance} {
+  UTIL_CHECK(num_brackets_ >= 1,
+             "Crossing integration requires at least 1 bracket");
+  UTIL_CHECK(tolerance_ > 0, "Invalid tolerance (", tolerance_, ")");
+
+  // Brackets with equal ray kernel mass
+  const ScalarType bracket_mass = static_cast<ScalarType>(1) / num_brackets_;
+  bracket_edges_.push_back(0);
+  for (size_t i = 1; i < num_brackets_; ++i) {
+    bracket_edges_.push_back(
+        ImportanceSamplingIntegrator::sample(bracket_mass * i).first);
   }
-  result /= num_grids_ * evals_per_grid_;
-  return result;
+  bracket_edges_.push_back(1);
+}
+
+std::string CrossingIntegrator::describe() const {
+  return util::concat_strings(
+      "CrossingIntegrator (num_brackets=", num_brackets_,
+      ", tolerance=", tolerance_,
+      ", fallback=ImportanceSamplingIntegrator without level set)");
+}
+
+std::optional<size_t> CrossingIntegrator::take_num_evals() const {
+  return num_evals_.exchange(0, std::memory_order_relaxed);
 }
 
 }  // namespace metaball
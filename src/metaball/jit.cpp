@@ -0,0 +1,370 @@
+#include "metaball/jit.hpp"
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "metaball/scene.hpp"
+#include "util/environment.hpp"
+#include "util/error.hpp"
+#include "util/file.hpp"
+#include "util/simd_math.hpp"
+#include "util/string.hpp"
+
+#ifndef METABALL_JIT_COMPILER
+#define METABALL_JIT_COMPILER "c++"
+#endif
+#ifndef METABALL_JIT_INCLUDE_DIR
+#define METABALL_JIT_INCLUDE_DIR "include"
+#endif
+
+namespace metaball {
+namespace jit {
+
+namespace {
+
+// Kernels read positions as packed arrays of scalars
+static_assert(sizeof(VectorType) == Scene::ndim * sizeof(ScalarType));
+static_assert(std::is_standard_layout_v<VectorType>);
+
+constexpr const char* scores_symbol = "metaball_jit_scores";
+constexpr const char* densities_symbol = "metaball_jit_densities";
+
+/*! \brief Maximum element terms in each generated loop
+ *
+ * Larger loops exceed the compiler's inlining limits, so calls to
+ * util::simd_math are not inlined and the loop is not vectorized.
+ */
+constexpr size_t terms_per_loop = 8;
+
+std::filesystem::path cache_dir() {
+  const auto dir = util::getenv<std::string>("METABALL_JIT_CACHE_DIR");
+  if (!dir.empty()) {
+    return dir;
+  }
+  return std::filesystem::temp_directory_path() / "metaball-jit";
+}
+
+/*! \brief Quote string for POSIX shell */
+std::string shell_quote(const std::string& str) {
+  std::string result = "'";
+  for (const auto& c : str) {
+    result += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  }
+  result += "'";
+  return result;
+}
+
+/*! \brief Shell command that compiles source file into shared library */
+std::string compile_command(const std::filesystem::path& source_file,
+                            const std::filesystem::path& library_file) {
+  const auto compiler = util::getenv<std::string>("METABALL_JIT_COMPILER",
+                                                  METABALL_JIT_COMPILER);
+  return util::concat_strings(
+      compiler, " -std=c++20 -O3 -march=native -fno-math-errno -fopenmp-simd",
+      " -fPIC -shared -I", shell_quote(METABALL_JIT_INCLUDE_DIR), " -o ",
+      shell_quote(library_file.string()), " ",
+      shell_quote(source_file.string()));
+}
+
+/*! \brief Cache file name without extension
+ *
+ * Hash of the source and the compile command.
+ */
+std::string cache_name(const std::string& source) {
+  // Note: The build time of this file also invalidates the cache
+  // when headers used by kernels change, since this file includes
+  // them too.
+  const auto command = compile_command("kernel.cpp", "kernel.so");
+  const auto key = std::hash<std::string>()(
+      util::concat_strings(__DATE__, " ", __TIME__, "\n", command, "\n",
+                           source));
+  std::ostringstream name;
+  name << "density-" << std::hex << std::setw(16) << std::setfill('0') << key;
+  return name.str();
+}
+
+/*! \brief Compile source into shared library, if not already cached */
+std::filesystem::path compile(const std::string& source) {
+  // Cached library path
+  const auto dir = cache_dir();
+  const auto name = cache_name(source);
+  const auto library_file = dir / (name + ".so");
+  if (util::file_exists(library_file.string())) {
+    return library_file;
+  }
+
+  // Write source file
+  // Note: Files are written with unique names and renamed into
+  // place, so concurrent builds never see partial files.
+  std::filesystem::create_directories(dir);
+  const auto unique_suffix = util::concat_strings(
+      ".", getpid(), "-",
+      std::hash<std::thread::id>()(std::this_thread::get_id()));
+  const auto source_file = dir / (name + unique_suffix + ".cpp");
+  const auto temp_library_file = dir / (name + unique_suffix + ".so");
+  {
+    std::ofstream file(source_file);
+    UTIL_CHECK(file.is_open(), "Could not open ", source_file.string());
+    file << source;
+  }
+
+  // Compile
+  const auto command = compile_command(source_file, temp_library_file);
+  const int status = std::system(command.c_str());
+  std::filesystem::remove(source_file);
+  UTIL_CHECK(status == 0, "Compilation failed with status ", status, " (",
+             command, ")");
+  std::filesystem::rename(temp_library_file, library_file);
+  return library_file;
+}
+
+/*! \brief Compile and load kernel
+ *
+ * Returns null and prints a warning if anything fails.
+ */
+std::unique_ptr<const DensityKernel> compile_and_load(
+    const std::string& source) {
+  try {
+    return DensityKernel::load(compile(source));
+  } catch (const std::exception& err) {
+    UTIL_WARN("Could not build JIT density kernel, ", err.what());
+    return nullptr;
+  }
+}
+
+}  // namespace
+
+DensityKernel::DensityKernel(void* handle, ScoresFunction scores_function,
+                             DensitiesFunction densities_function)
+    : handle_{handle},
+      scores_function_{scores_function},
+      densities_function_{densities_function} {}
+
+DensityKernel::~DensityKernel() { dlclose(handle_); }
+
+std::unique_ptr<DensityKernel> DensityKernel::load(
+    const std::filesystem::path& library) {
+  void* handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    const std::string_view message = dlerror();
+    UTIL_ERROR("Could not load ", library.string(), " (", message, ")");
+  }
+  auto* scores_function =
+      reinterpret_cast<ScoresFunction>(dlsym(handle, scores_symbol));
+  auto* densities_function =
+      reinterpret_cast<DensitiesFunction>(dlsym(handle, densities_symbol));
+  if (scores_function == nullptr || densities_function == nullptr) {
+    dlclose(handle);
+    UTIL_ERROR("Could not find kernel functions in ", library.string());
+  }
+  return std::unique_ptr<DensityKernel>(
+      new DensityKernel(handle, scores_function, densities_function));
+}
+
+void DensityKernel::compute_scores(std::span<const VectorType> positions,
+                                   std::span<ScalarType> scores) const {
+  UTIL_CHECK(positions.size() == scores.size(), "Attempted to compute ",
+             positions.size(), " scores into ", scores.size(), " outputs");
+  scores_function_(reinterpret_cast<const ScalarType*>(positions.data()),
+                   scores.data(), positions.size());
+}
+
+void DensityKernel::compute_densities(std::span<const VectorType> positions,
+                                      std::span<ScalarType> densities,
+                                      ScalarType threshold,
+                                      ScalarType threshold_width) const {
+  UTIL_CHECK(positions.size() == densities.size(), "Attempted to compute ",
+             positions.size(), " densities into ", densities.size(),
+             " outputs");
+  densities_function_(reinterpret_cast<const ScalarType*>(positions.data()),
+                      densities.data(), positions.size(), threshold,
+                      threshold_width);
+}
+
+KernelBuild::KernelBuild()
+    : finished_future_{finished_promise_.get_future().share()} {}
+
+const DensityKernel* KernelBuild::kernel() const {
+  return finished() ? kernel_.get() : nullptr;
+}
+
+bool KernelBuild::finished() const {
+  return finished_.load(std::memory_order_acquire);
+}
+
+void KernelBuild::wait() const { finished_future_.wait(); }
+
+void KernelBuild::finish(std::unique_ptr<const DensityKernel>&& kernel) {
+  UTIL_CHECK(!finished(), "Attempted to finish kernel build twice");
+  kernel_ = std::move(kernel);
+  finished_.store(true, std::memory_order_release);
+  finished_promise_.set_value();
+}
+
+std::optional<std::string> generate_source(
+    std::span<const PackedSceneElement> elements, Scene::Accuracy accuracy) {
+  // Element terms
+  std::vector<std::vector<std::string>> element_terms;
+  size_t num_terms = 0;
+  for (const auto& packed : elements) {
+    element_terms.push_back(std::visit(
+        [](const auto& element) -> std::vector<std::string> {
+          using ElementType = std::decay_t<decltype(element)>;
+          return element.ElementType::source_terms();
+        },
+        packed));
+    num_terms += element_terms.back().size();
+    if (num_terms > max_source_terms) {
+      return std::nullopt;
+    }
+  }
+
+  std::string source;
+  auto _ = [&source]<typename... Ts>(const Ts&... args) {
+    (..., (source += util::to_string_like(args)));
+    source += "\n";
+  };
+  const std::string accuracy_name =
+      accuracy == Scene::Accuracy::Full
+          ? "Full"
+          : (accuracy == Scene::Accuracy::Medium ? "Medium" : "Low");
+
+  // Headers and helper functions
+  _("// Generated by metaball::jit::generate_source");
+  _("#include <algorithm>");
+  _("#include <cmath>");
+  _("#include <cstddef>");
+  _("#include <vector>");
+  _();
+  _("#include \"util/simd_math.hpp\"");
+  _();
+  _("namespace {");
+  _();
+  _("constexpr auto accuracy = util::simd_math::Accuracy::", accuracy_name,
+    ";");
+  _();
+  _("inline double square(double x) { return x * x; }");
+  _();
+
+  // Loops over positions for sums of element terms
+  // Note: Each loop is a separate function, since compilers limit
+  // inlining by function size.
+  size_t num_loops = 0;
+  for (const auto& terms : element_terms) {
+    for (size_t begin = 0; begin < terms.size(); begin += terms_per_loop) {
+      const size_t end = std::min(begin + terms_per_loop, terms.size());
+      _("void add_terms_", num_loops++,
+        "(const double* x0s, const double* x1s, const double* x2s,");
+      _("    const double* x3s, double* scores, std::size_t size) {");
+      _("#pragma omp simd");
+      _("  for (std::size_t i = 0; i < size; ++i) {");
+      _("    const double x0 = x0s[i], x1 = x1s[i], x2 = x2s[i], x3 = x3s[i];");
+      _("    double score = 0;");
+      for (size_t k = begin; k < end; ++k) {
+        _("    score += ", terms[k], ";");
+      }
+      _("    scores[i] += score;");
+      _("  }");
+      _("}");
+      _();
+    }
+  }
+  _("}  // namespace");
+  _();
+
+  // Sum of scene elements
+  // Note: Positions are transposed into a structure of arrays, as in
+  // the SIMD loops of the interpreted kernels.
+  _("extern \"C\" void ", scores_symbol,
+    "(const double* positions, double* scores,");
+  _("                                    std::size_t size) {");
+  _("  thread_local std::vector<double> buffer;");
+  _("  buffer.resize(4 * size);");
+  _("  double* const x0s = buffer.data();");
+  _("  double* const x1s = x0s + size;");
+  _("  double* const x2s = x1s + size;");
+  _("  double* const x3s = x2s + size;");
+  _("  for (std::size_t i = 0; i < size; ++i) {");
+  _("    x0s[i] = positions[4 * i];");
+  _("    x1s[i] = positions[4 * i + 1];");
+  _("    x2s[i] = positions[4 * i + 2];");
+  _("    x3s[i] = positions[4 * i + 3];");
+  _("    scores[i] = 0;");
+  _("  }");
+  for (size_t loop = 0; loop < num_loops; ++loop) {
+    _("  add_terms_", loop, "(x0s, x1s, x2s, x3s, scores, size);");
+  }
+  _("}");
+  _();
+
+  // Density threshold
+  _("extern \"C\" void ", densities_symbol,
+    "(const double* positions, double* densities,");
+  _("                                       std::size_t size, double "
+    "threshold,");
+  _("                                       double width) {");
+  _("  ", scores_symbol, "(positions, densities, size);");
+  _("  if (width == 0) {");
+  _("    for (std::size_t i = 0; i < size; ++i) {");
+  _("      densities[i] = densities[i] >= threshold ? 1. : 0.;");
+  _("    }");
+  _("    return;");
+  _("  }");
+  _("#pragma omp simd");
+  _("  for (std::size_t i = 0; i < size; ++i) {");
+  _("    densities[i] =");
+  _("        util::simd_math::sigmoid<accuracy>((densities[i] - threshold) / "
+    "width);");
+  _("  }");
+  _("}");
+  return source;
+}
+
+std::shared_ptr<KernelBuild> build_kernel(std::string source) {
+  auto build = std::make_shared<KernelBuild>();
+
+  // Load cached kernel immediately
+  const auto cached_library = cache_dir() / (cache_name(source) + ".so");
+  if (util::file_exists(cached_library.string())) {
+    build->finish(compile_and_load(source));
+    return build;
+  }
+
+  // Compile in background thread
+  std::weak_ptr<KernelBuild> weak_build = build;
+  std::thread([weak_build, source = std::move(source)] {
+    std::this_thread::sleep_for(std::chrono::duration<double>(debounce_time));
+    if (auto build = weak_build.lock()) {
+      build->finish(compile_and_load(source));
+    }
+  }).detach();
+  return build;
+}
+
+std::string literal(ScalarType value) {
+  std::ostringstream ss;
+  ss << std::hexfloat << value;
+  return value < 0 ? util::concat_strings("(", ss.str(), ")") : ss.str();
+}
+
+}  // namespace jit
+}  // namespace metaball
@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "metaball/bench.hpp"
+#include "metaball/camera.hpp"
+#include "metaball/commands.hpp"
+#include "metaball/image.hpp"
+#include "metaball/integrator.hpp"
+#include "metaball/random.hpp"
+#include "metaball/scene.hpp"
+#include "util/environment.hpp"
+#include "util/error.hpp"
+#include "util/string.hpp"
+
+namespace {
+
+using metaball::Camera;
+using metaball::Image;
+using metaball::Integrator;
+using metaball::Scene;
+using metaball::bench::element_configs;
+using metaball::bench::measure_seconds;
+using metaball::bench::random_seed;
+using metaball::bench::scene_presets;
+using ScalarType = Scene::ScalarType;
+
+/*! \brief Harness options from environment variables */
+struct Options {
+  size_t resolution;
+  std::string reference;
+  double min_seconds;
+  double target_psnr;
+  std::string csv_file;
+};
+
+/*! \brief Integrator configs to compare against reference */
+std::vector<std::string> make_integrator_configs() {
+  const std::vector<std::string> types = {"grid",
+                                          "trapezoid",
+                                          "monte carlo",
+                                          "stratified sampling",
+                                          "importance sampling",
+                                          "qmc",
+                                          "gauss laguerre",
+                                          "clenshaw curtis",
+                                          "crossing"};
+  const std::vector<size_t> num_evals_list = {4, 8, 16, 32, 64, 128};
+  const std::vector<std::string> tolerances = {"1e-1", "3e-2", "1e-2",
+                                               "3e-3", "1e-3"};
+  std::vector<std::string> configs;
+  for (const auto& type : types) {
+    for (const auto& num_evals : num_evals_list) {
+      configs.push_back(util::concat_strings(type, " = ", num_evals));
+    }
+  }
+  for (const auto& tolerance : tolerances) {
+    configs.push_back(util::concat_strings("adaptive = ", tolerance));
+  }
+  return configs;
+}
+
+/*! \brief Scenes from README presets and each scene element type */
+std::vector<std::pair<std::string, std::string>> make_scenes() {
+  auto scenes = scene_presets;
+  for (const auto& config : element_configs) {
+    scenes.emplace_back(
+        config, util::concat_strings("reset scene; reset camera; add scene = ",
+                                     config));
+  }
+  return scenes;
+}
+
+/*! \brief Root-mean-square difference between images */
+double compute_rmse(const Image& image, const Image& reference) {
+  UTIL_CHECK(image.height() == reference.height() &&
+                 image.width() == reference.width(),
+             "Image dimensions do not match");
+  double sum = 0;
+  for (size_t i = 0; i < image.height(); ++i) {
+    for (size_t j = 0; j < image.width(); ++j) {
+      const auto pixel = image.get(i, j);
+      const auto reference_pixel = reference.get(i, j);
+      for (size_t c = 0; c < 3; ++c) {
+        const double diff = pixel[c] - reference_pixel[c];
+        sum += diff * diff;
+      }
+    }
+  }
+  return std::sqrt(sum / (3 * image.height() * image.width()));
+}
+
+/*! \brief Peak signal-to-noise ratio in dB, for pixels in [0,1] */
+double compute_psnr(double rmse) {
+  if (rmse == 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return -20 * std::log10(rmse);
+}
+
+struct Measurement {
+  std::string config;
+  double seconds;
+  double evals_per_pixel;
+  double rmse;
+  bool pareto_seconds = false;
+  bool pareto_evals = false;
+};
+
+/*! \brief Mark measurements that are not dominated in cost and error */
+void mark_pareto(std::vector<Measurement>& measurements) {
+  auto dominates = [](double cost, double rmse, double other_cost,
+                      double other_rmse) -> bool {
+    return cost <= other_cost && rmse <= other_rmse &&
+           (cost < other_cost || rmse < other_rmse);
+  };
+  for (auto& m : measurements) {
+    m.pareto_seconds = m.pareto_evals = true;
+    for (const auto& other : measurements) {
+      if (dominates(other.seconds, other.rmse, m.seconds, m.rmse)) {
+        m.pareto_seconds = false;
+      }
+      if (dominates(other.evals_per_pixel, other.rmse, m.evals_per_pixel,
+                    m.rmse)) {
+        m.pareto_evals = false;
+      }
+    }
+  }
+}
+
+/*! \brief Render and time scene with integrator */
+Measurement measure(const std::string& config, const Scene& scene,
+                    const Camera& camera, const Image& reference,
+                    const Options& options) {
+  const auto integrator = Integrator::make_integrator(config);
+  const auto resolution = options.resolution;
+  const auto num_pixels = resolution * resolution;
+
+  // Render image and count integrand evaluations
+  // Note: Evaluations are counted by the scene, since segments of
+  // rays with known density are not sampled.
+  metaball::random::seed(random_seed);
+  scene.take_num_ray_samples();
+  const auto image =
+      camera.make_image(scene, *integrator, resolution, resolution);
+  const auto evals_per_pixel =
+      static_cast<double>(scene.take_num_ray_samples()) / num_pixels;
+
+  // Time rendering
+  const auto seconds = measure_seconds(
+      [&] { camera.make_image(scene, *integrator, resolution, resolution); },
+      options.min_seconds);
+
+  return {config, seconds, evals_per_pixel, compute_rmse(image, reference)};
+}
+
+void print_header() {
+  std::cout << "  " << std::left << std::setw(28) << "integrator" << std::right
+            << std::setw(12) << "ms/frame" << std::setw(12) << "evals/px"
+            << std::setw(10) << "RMSE" << std::setw(10) << "PSNR"
+            << "  pareto\n";
+}
+
+void print_row(const Measurement& m) {
+  std::string pareto;
+  if (m.pareto_seconds) {
+    pareto += "time";
+  }
+  if (m.pareto_evals) {
+    pareto += pareto.empty() ? "evals" : ", evals";
+  }
+  std::cout << "  " << std::left << std::setw(28) << m.config << std::right
+            << std::fixed << std::setprecision(2) << std::setw(12)
+            << 1e3 * m.seconds << std::setprecision(1) << std::setw(12)
+            << m.evals_per_pixel << std::setprecision(4) << std::setw(10)
+            << m.rmse << std::setprecision(1) << std::setw(10)
+            << compute_psnr(m.rmse) << "  " << pareto << "\n"
+            << std::flush;
+}
+
+/*! \brief Compare integrators on one scene */
+void run_scene(const std::string& scene_name,
+               const std::string& scene_commands,
+               const std::vector<std::string>& configs, const Options& options,
+               std::ofstream& csv) {
+  Scene scene;
+  std::unique_ptr<Integrator> integrator;
+  Camera camera;
+  metaball::random::seed(random_seed);
+  metaball::run_render_commands(scene_commands, scene, integrator, camera);
+
+  // Reference image
+  const auto reference_integrator =
+      Integrator::make_integrator(options.reference);
+  const auto reference = camera.make_image(
+      scene, *reference_integrator, options.resolution, options.resolution);
+
+  // Measure integrators
+  std::cout << "Scene: " << scene_name << "\n";
+  print_header();
+  std::vector<Measurement> measurements;
+  for (const auto& config : configs) {
+    measurements.push_back(measure(config, scene, camera, reference, options));
+  }
+  mark_pareto(measurements);
+  for (const auto& m : measurements) {
+    print_row(m);
+    if (csv.is_open()) {
+      csv << "\"" << scene_name << "\",\"" << m.config << "\"," << m.seconds
+          << "," << m.evals_per_pixel << "," << m.rmse << ","
+          << compute_psnr(m.rmse) << "," << m.pareto_seconds << ","
+          << m.pareto_evals << "\n";
+    }
+  }
+
+  // Cheapest integrator that meets quality target
+  const Measurement* cheapest = nullptr;
+  for (const auto& m : measurements) {
+    if (compute_psnr(m.rmse) >= options.target_psnr &&
+        (cheapest == nullptr || m.seconds < cheapest->seconds)) {
+      cheapest = &m;
+    }
+  }
+  std::cout << "  Cheapest with PSNR >= " << std::setprecision(1)
+            << options.target_psnr << " dB: "
+            << (cheapest == nullptr ? "none" : cheapest->config) << "\n\n"
+            << std::flush;
+}
+
+std::string help_message() {
+  std::string result;
+  auto _ = [&result]<typename... Ts>(const Ts&... args) {
+    (..., (result += util::to_string_like(args)));
+    result += "\n";
+  };
+  _("Usage: metaball_pareto [SCENE...]");
+  _();
+  _("Compare integrator accuracy and cost. Each scene is rendered with a");
+  _("reference integrator, then with a sweep of integrators and sample");
+  _("counts. Reports time per frame, integrand evaluations per pixel, and");
+  _("RMSE and PSNR against the reference, and marks configs on the");
+  _("Pareto front of error vs time and error vs evaluations. By default,");
+  _("all scenes are run: README presets and one per scene element type.");
+  _();
+  _("Environment variables:");
+  _("  METABALL_PARETO_RESOLUTION   Image height and width (default 64)");
+  _("  METABALL_PARETO_REFERENCE    Reference integrator (default grid = "
+    "4096)");
+  _("  METABALL_PARETO_MIN_SECONDS  Minimum time per measurement (default "
+    "0.05)");
+  _("  METABALL_PARETO_TARGET_PSNR  Quality target in dB (default 30)");
+  _("  METABALL_PARETO_CSV          Also write results to CSV file");
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && (std::string_view(argv[1]) == "-h" ||
+                   std::string_view(argv[1]) == "--help")) {
+    std::cout << help_message() << std::flush;
+    return 0;
+  }
+
+  try {
+    const Options options{
+        util::getenv<size_t>("METABALL_PARETO_RESOLUTION", 64),
+        util::getenv<std::string>("METABALL_PARETO_REFERENCE", "grid = 4096"),
+        util::getenv<double>("METABALL_PARETO_MIN_SECONDS", 0.05),
+        util::getenv<double>("METABALL_PARETO_TARGET_PSNR", 30),
+        util::getenv<std::string>("METABALL_PARETO_CSV", "")};
+
+    // Optionally run a subset of scenes
+    auto scenes = make_scenes();
+    if (argc > 1) {
+      std::vector<std::pair<std::string, std::string>> selected;
+      for (int arg = 1; arg < argc; ++arg) {
+        const std::string_view name = argv[arg];
+        const auto it = std::find_if(
+            scenes.begin(), scenes.end(),
+            [&](const auto& scene) { return scene.first == name; });
+        UTIL_CHECK(it != scenes.end(), "Unrecognized scene (", name, ")");
+        selected.push_back(*it);
+      }
+      scenes = std::move(selected);
+    }
+
+    std::ofstream csv;
+    if (!options.csv_file.empty()) {
+      csv.open(options.csv_file);
+      UTIL_CHECK(csv.is_open(), "Could not open ", options.csv_file);
+      csv << "scene,integrator,seconds,evals_per_pixel,rmse,psnr,"
+             "pareto_seconds,pareto_evals\n";
+    }
+
+    const auto configs = make_integrator_configs();
+    for (const auto& [scene_name, scene_commands] : scenes) {
+      run_scene(scene_name, scene_commands, configs, options, csv);
+    }
+  } catch (const std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -42,5 +42,7 @@ std::mt19937& generator() {
   return gen;
 }
 
+void seed(uint32_t value) { generator().seed(value); }
+
 }  // namespace random
 }  // namespace metaball
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "metaball/camera.hpp"
+#include "metaball/commands.hpp"
+#include "metaball/image.hpp"
+#include "metaball/integrator.hpp"
+#include "metaball/scene.hpp"
+#include "util/error.hpp"
+#include "util/string.hpp"
+
+namespace {
+
+std::string help_message() {
+  std::string result;
+  auto _ = [&result]<typename... Ts>(const Ts&... args) {
+    (..., (result += util::to_string_like(args)));
+    result += "\n";
+  };
+  _("Usage: metaball_render COMMANDS...");
+  _();
+  _("Render metaball images without a display. Each argument is a");
+  _("list of commands separated by \";\", which are run in order.");
+  _("Scene, integrator, and camera commands are the same as in the");
+  _("interactive application. Additional commands:");
+  _();
+  _("  image size = HEIGHT, WIDTH   Set output resolution (default 512, 512)");
+  _("  save = FILE                  Render and write binary PPM image");
+  _();
+  _("Example:");
+  _("  metaball_render \"reset scene; add scene = power decay = 16, 2\" \\");
+  _("    \"image size = 1080, 1920; save = blobs.ppm\"");
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  using namespace metaball;
+
+  if (argc < 2) {
+    std::cerr << help_message() << std::flush;
+    return 1;
+  }
+  const std::string_view first_arg = argv[1];
+  if (first_arg == "-h" || first_arg == "--help") {
+    std::cout << help_message() << std::flush;
+    return 0;
+  }
+
+  // Initial state matches the interactive application
+  Scene scene;
+  scene.add_element(SceneElement::make_element("polynomial"));
+  auto integrator = Integrator::make_integrator("stratified sampling");
+  Camera camera;
+  size_t height = 512, width = 512;
+
+  try {
+    for (int arg = 1; arg < argc; ++arg) {
+      for (const auto& [name, params] : parse_commands(argv[arg])) {
+        if (name == "") {
+          continue;
+        }
+        if (run_render_command(name, params, scene, integrator, camera)) {
+          continue;
+        }
+        if (name == "image size") {
+          const auto& params_split = util::split(params, ",");
+          UTIL_CHECK(params_split.size() == 2, "Invalid image size (", params,
+                     ")");
+          height = util::from_string<size_t>(util::strip(params_split[0]));
+          width = util::from_string<size_t>(util::strip(params_split[1]));
+          continue;
+        }
+        if (name == "save") {
+          UTIL_CHECK(integrator != nullptr,
+                     "Integrator has not been initialized");
+          const std::string file =
+              params.empty() ? "metaball.ppm" : std::string(params);
+          integrator->take_num_evals();
+          const auto start_time = std::chrono::steady_clock::now();
+          const auto image =
+              camera.make_image(scene, *integrator, height, width);
+          const std::chrono::duration<double> render_time =
+              std::chrono::steady_clock::now() - start_time;
+          const auto num_evals = integrator->take_num_evals();
+          image.save_ppm(file);
+          std::string stats = util::concat_strings(render_time.count(), " sec");
+          if (num_evals) {
+            stats += util::concat_strings(
+                ", ", *num_evals, " integrand evals, ",
+                static_cast<double>(*num_evals) / (height * width),
+                " per pixel");
+          }
+          std::cout << util::concat_strings("Saved image at ", file, " (",
+                                            stats, ")\n")
+                    << std::flush;
+          continue;
+        }
+        UTIL_ERROR("Unrecognized command: ", name);
+      }
+    }
+  } catch (const std::exception& err) {
+    std::cerr << err.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
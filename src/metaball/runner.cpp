@@ -26,15 +26,32 @@
 #include <vector>
 
 #include "metaball/camera.hpp"
+#include "metaball/commands.hpp"
 #include "metaball/image.hpp"
 #include "metaball/integrator.hpp"
 #include "metaball/random.hpp"
 #include "metaball/scene.hpp"
+#include "util/simd_math.hpp"
 #include "util/string.hpp"
 #include "util/vector.hpp"
 
 namespace metaball {
 
+namespace {
+
+QImage to_qimage(const Image& image) {
+  QImage result(image.width(), image.height(), QImage::Format_RGB32);
+  for (size_t i = 0; i < image.height(); ++i) {
+    for (size_t j = 0; j < image.width(); ++j) {
+      const auto [r, g, b] = image.get_8bit(i, j);
+      result.setPixel(j, i, qRgb(r, g, b));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
 Runner::Runner(QWidget* parent)
     : QWidget(parent),
       integrator_{Integrator::make_integrator("stratified sampling")} {
@@ -137,8 +154,10 @@ std::string Runner::info_message() const {
   for (size_t i = 0; i < scene_.num_elements(); ++i) {
     _("  ", i, ": ", scene_.get_element(i).describe());
   }
+  _("Compiled elements: ", scene_.compiled_elements().size());
   _("Density threshold: ", scene_.density_threshold());
   _("Density threshold width: ", scene_.density_threshold_width());
+  _("Math accuracy: ", util::simd_math::to_string(scene_.math_accuracy()));
 
   // Integrator properties
   _();
@@ -149,6 +168,11 @@ std::string Runner::info_message() const {
   } else {
     _("Integrator: ", integrator_->describe());
   }
+  if (last_frame_num_evals_) {
+    const auto num_pixels = static_cast<double>(height() * width());
+    _("Integrand evaluations in last frame: ", *last_frame_num_evals_, " (",
+      *last_frame_num_evals_ / num_pixels, " per pixel)");
+  }
 
   // Camera properties
   _();
@@ -252,8 +276,10 @@ void Runner::paintEvent(QPaintEvent*) {
 
   // Render image
   UTIL_CHECK(integrator_ != nullptr, "Integrator has not been initialized");
+  integrator_->take_num_evals();
   auto image = camera_.make_image(scene_, *integrator_, height(), width());
-  painter.drawImage(0, 0, image);
+  last_frame_num_evals_ = integrator_->take_num_evals();
+  painter.drawImage(0, 0, to_qimage(image));
 }
 
 void Runner::timer_step() {
@@ -298,14 +324,7 @@ void Runner::timer_step_command_input() {
 
   // Parse and run commands
   for (const auto& input_line : input_lines) {
-    for (const auto& unparsed_command : util::split(input_line, ";")) {
-      const auto command = util::split(unparsed_command, "=", 2);
-      UTIL_CHECK(command.size() >= 1, "error parsing command (",
-                 unparsed_command, ")");
-      UTIL_CHECK(command.size() <= 2, "error parsing command (",
-                 unparsed_command, ")");
-      const auto& name = util::strip(command[0]);
-      const auto& params = command.size() > 1 ? util::strip(command[1]) : "";
+    for (const auto& [name, params] : parse_commands(input_line)) {
       try {
         run_command(name, params);
       } catch (const std::exception& err) {
@@ -438,8 +457,6 @@ void Runner::timer_step_drift_movement(double step_interval) {
 
 void Runner::run_command(const std::string_view& name,
                          const std::string_view& params) {
-  using ScalarType = Scene::ScalarType;
-
   // Basic commands
   if (name == "") {
     return;
@@ -460,7 +477,7 @@ void Runner::run_command(const std::string_view& name,
     auto image = camera_.make_image(scene_, *integrator_, height(), width());
     const std::string file =
         params.empty() ? "metaball.png" : std::string(params);
-    static_cast<QImage>(image).save(QString(file.data()));
+    to_qimage(image).save(QString(file.data()));
     std::cout << util::concat_strings("Saved image at ", file, "\n")
               << std::flush;
     return;
@@ -480,71 +497,8 @@ void Runner::run_command(const std::string_view& name,
     return;
   }
 
-  // Camera commands
-  if (name == "reset camera") {
-    camera_ = {};
-    return;
-  }
-  if (name == "focal length") {
-    camera_.set_focal_length(util::from_string<ScalarType>(params));
-    return;
-  }
-  if (name == "film speed") {
-    camera_.set_film_speed(util::from_string<ScalarType>(params));
-    return;
-  }
-  if (Camera::is_adjust_shot_type(name)) {
-    camera_.adjust_shot(name, util::from_string<ScalarType>(params));
-    return;
-  }
-  if (name == "random orientation") {
-    camera_.set_orientation(random::randn<Camera::VectorType>(),
-                            random::randn<Camera::VectorType>(),
-                            random::randn<Camera::VectorType>());
-    return;
-  }
-
-  // Scene commands
-  if (name == "reset scene") {
-    scene_ = {};
-    return;
-  }
-  if (name == "add scene") {
-    scene_.add_element(SceneElement::make_element(params));
-    return;
-  }
-  if (name == "remove scene") {
-    size_t idx = 0;
-    if (params.empty()) {
-      if (scene_.num_elements() > 0) {
-        idx = scene_.num_elements() - 1;
-      }
-    } else {
-      idx = util::from_string<size_t>(params);
-    }
-    scene_.remove_element(idx);
-    return;
-  }
-  if (name == "delete scene") {
-    if (params.empty()) {
-      if (scene_.num_elements() > 0) {
-        scene_.remove_element(scene_.num_elements() - 1);
-      }
-    } else {
-      scene_.remove_element(util::from_string<size_t>(params));
-    }
-    return;
-  }
-  if (name == "density threshold") {
-    scene_.set_density_threshold(util::from_string<ScalarType>(params));
-    return;
-  }
-  if (name == "density threshold width") {
-    scene_.set_density_threshold_width(util::from_string<ScalarType>(params));
-    return;
-  }
-  if (name == "set integrator") {
-    integrator_ = Integrator::make_integrator(params);
+  // Scene, integrator, and camera commands
+  if (run_render_command(name, params, scene_, integrator_, camera_)) {
     return;
   }
 
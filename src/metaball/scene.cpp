@@ -1,24 +1,850 @@
 #include "metaball/scene.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <numbers>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <typeinfo>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "metaball/integrator.hpp"
+#include "metaball/jit.hpp"
 #include "metaball/random.hpp"
 #include "util/error.hpp"
-#include "util/math.hpp"
+#include "util/nufft.hpp"
+#include "util/simd_math.hpp"
 #include "util/string.hpp"
 #include "util/vector.hpp"
 
 namespace metaball {
 
+namespace {
+
+using ScalarType = Scene::ScalarType;
+using VectorType = Scene::VectorType;
+using Accuracy = Scene::Accuracy;
+
+/*! \brief Evaluate function at positions and write or add to output */
+template <typename Func>
+inline void evaluate_positions(std::span<const VectorType> positions,
+                               std::span<ScalarType> out, bool accumulate,
+                               Func&& func) {
+  UTIL_CHECK(positions.size() == out.size(), "Attempted to evaluate ",
+             positions.size(), " positions into ", out.size(), " outputs");
+  if (accumulate) {
+    for (size_t i = 0; i < positions.size(); ++i) {
+      out[i] += func(positions[i]);
+    }
+  } else {
+    for (size_t i = 0; i < positions.size(); ++i) {
+      out[i] = func(positions[i]);
+    }
+  }
+}
+
+/*! \brief Append copy of scene element to packed storage
+ *
+ * Sums of elements are flattened into their components.
+ */
+template <size_t variant_index = 0>
+void pack_element(const SceneElement& element,
+                  std::vector<PackedSceneElement>& packed) {
+  if constexpr (variant_index == 0) {
+    if (const auto* multi = dynamic_cast<const MultiSceneElement*>(&element)) {
+      for (size_t i = 0; i < multi->num_elements(); ++i) {
+        pack_element(multi->get_element(i), packed);
+      }
+      return;
+    }
+  }
+  if constexpr (variant_index < std::variant_size_v<PackedSceneElement>) {
+    using ElementType =
+        std::variant_alternative_t<variant_index, PackedSceneElement>;
+    if (typeid(element) == typeid(ElementType)) {
+      packed.emplace_back(std::in_place_index<variant_index>,
+                          static_cast<const ElementType&>(element));
+      return;
+    }
+    pack_element<variant_index + 1>(element, packed);
+  } else {
+    UTIL_ERROR("Scene element can not be packed (", element.describe(), ")");
+  }
+}
+
+/*! \brief C++ expressions for position minus center, for JIT kernels */
+std::array<std::string, Scene::ndim> source_offset(const VectorType& center) {
+  std::array<std::string, Scene::ndim> offset;
+  for (size_t d = 0; d < Scene::ndim; ++d) {
+    offset[d] = util::concat_strings("(x", d, " - ", jit::literal(center[d]),
+                                     ")");
+  }
+  return offset;
+}
+
+/*! \brief C++ expression for squared norm, for JIT kernels */
+std::string source_norm2(const std::array<std::string, Scene::ndim>& vec) {
+  std::string result = "(";
+  for (size_t d = 0; d < Scene::ndim; ++d) {
+    result += util::concat_strings(d > 0 ? " + " : "", "square(", vec[d], ")");
+  }
+  result += ")";
+  return result;
+}
+
+/*! \brief C++ expression for dot product with constant, for JIT kernels */
+std::string source_dot(const std::array<std::string, Scene::ndim>& vec,
+                       const VectorType& constant) {
+  std::string result = "(";
+  for (size_t d = 0; d < Scene::ndim; ++d) {
+    result += util::concat_strings(d > 0 ? " + " : "", vec[d], " * ",
+                                   jit::literal(constant[d]));
+  }
+  result += ")";
+  return result;
+}
+
+/*! \brief Distance parameters for point, see RaySceneElements */
+std::pair<ScalarType, ScalarType> ray_distance(const VectorType& origin,
+                                               const VectorType& direction,
+                                               const VectorType& center) {
+  const auto offset = origin - center;
+  const auto shift = util::dot(offset, direction);
+  const auto perp2 = (offset - shift * direction).norm2();
+  return {shift, perp2};
+}
+
+/*! \brief Lower and upper bounds
+ *
+ * Unlike std::pair, this is kept in registers in SIMD loops.
+ */
+struct Bounds {
+  ScalarType lower;
+  ScalarType upper;
+};
+
+/*! \brief Value and derivative of function
+ *
+ * Unlike std::pair, this is kept in registers in SIMD loops.
+ */
+struct ValueAndDerivative {
+  ScalarType value;
+  ScalarType derivative;
+};
+
+/*! \brief Value and variance of band-limited forms
+ *
+ * Unlike std::pair, this is kept in registers in SIMD loops.
+ */
+struct ValueAndVariance {
+  ScalarType value;
+  ScalarType variance;
+};
+
+/*! \brief Value of rate*x^2 where band-limited forms vanish
+ *
+ * See RayForms::band_limit.
+ */
+constexpr ScalarType band_limit_cutoff = 16;
+
+/*! \brief 1D forms along ray, see RaySceneElements */
+template <Accuracy accuracy>
+struct RayForms {
+  UTIL_SIMD_INLINE static ScalarType distance2(ScalarType x, ScalarType shift,
+                                               ScalarType perp2) {
+    const auto y = x + shift;
+    return y * y + perp2;
+  }
+
+  UTIL_SIMD_INLINE static ScalarType radial(ScalarType x, ScalarType shift,
+                                            ScalarType perp2,
+                                            ScalarType decay_square,
+                                            ScalarType amplitude) {
+    return amplitude / (1 + decay_square * distance2(x, shift, perp2));
+  }
+
+  UTIL_SIMD_INLINE static ScalarType sinusoid(ScalarType x,
+                                              ScalarType frequency,
+                                              ScalarType phase,
+                                              ScalarType amplitude) {
+    return amplitude *
+           util::simd_math::cos_cycles<accuracy>(frequency * x + phase);
+  }
+
+  UTIL_SIMD_INLINE static ScalarType radial_sinusoid(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType frequency,
+      ScalarType phase, ScalarType amplitude) {
+    const auto r = std::sqrt(distance2(x, shift, perp2));
+    return amplitude *
+           util::simd_math::cos_cycles<accuracy>(frequency * r + phase);
+  }
+
+  /*! \brief Gaussian factor of band-limited forms
+   *
+   * exp(-q) with q=rate*x^2 is approximated by (1-q/16)^16, which
+   * takes a few multiplies and vanishes smoothly at q=16. The factor
+   * only shapes the footprint filter, so its error of a few percent
+   * near q=1 does not matter.
+   */
+  UTIL_SIMD_INLINE static ScalarType band_limit(ScalarType x,
+                                                ScalarType rate) {
+    static_assert(band_limit_cutoff == 16);
+    const auto q = rate * x * x;
+    auto factor = 1 - q * (1 / band_limit_cutoff);
+    factor = factor > 0 ? factor : 0;
+    factor *= factor;
+    factor *= factor;
+    factor *= factor;
+    return factor * factor;
+  }
+
+  /*! \brief Band-limited value and its resolved variance
+   *
+   * With the phase uniformly distributed over the footprint, a
+   * sinusoid has variance amplitude^2/2, of which
+   * (amplitude*factor)^2/2 remains after averaging.
+   */
+  UTIL_SIMD_INLINE static ValueAndVariance band_limit_with_variance(
+      ScalarType value, ScalarType amplitude, ScalarType x, ScalarType rate) {
+    const auto factor = band_limit(x, rate);
+    const auto resolved = amplitude * factor;
+    return {value * factor, resolved * resolved / 2};
+  }
+
+  UTIL_SIMD_INLINE static ValueAndVariance band_limited_sinusoid(
+      ScalarType x, ScalarType frequency, ScalarType phase,
+      ScalarType amplitude, ScalarType rate) {
+    return band_limit_with_variance(
+        sinusoid(x, frequency, phase, amplitude), amplitude, x, rate);
+  }
+
+  UTIL_SIMD_INLINE static ValueAndVariance band_limited_radial_sinusoid(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType frequency,
+      ScalarType phase, ScalarType amplitude, ScalarType rate) {
+    return band_limit_with_variance(
+        radial_sinusoid(x, shift, perp2, frequency, phase, amplitude),
+        amplitude, x, rate);
+  }
+
+  /*! \brief Depths where band-limited form is not dropped */
+  static Bounds band_limit_support(ScalarType rate) {
+    const auto half_width =
+        rate > 0 ? std::sqrt(band_limit_cutoff / rate)
+                 : std::numeric_limits<ScalarType>::infinity();
+    return {-half_width, half_width};
+  }
+
+  UTIL_SIMD_INLINE static ScalarType polar_sinusoid(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType axial_slope,
+      ScalarType axial_offset, ScalarType radial_frequency,
+      ScalarType polar_frequency, ScalarType phase, ScalarType amplitude) {
+    constexpr ScalarType one = 1;
+    const auto r = std::sqrt(distance2(x, shift, perp2));
+    const auto cos_theta = (axial_slope * x + axial_offset) / r;
+    const auto theta =
+        util::simd_math::acos<accuracy>(std::clamp(cos_theta, -one, one));
+    return amplitude * util::simd_math::cos_cycles<accuracy>(
+                           radial_frequency * r + polar_frequency * theta +
+                           phase);
+  }
+
+  UTIL_SIMD_INLINE static ScalarType minus_exp(ScalarType x, ScalarType shift,
+                                               ScalarType perp2,
+                                               ScalarType dist_scale_square) {
+    return -util::simd_math::expm1<accuracy>(dist_scale_square *
+                                             distance2(x, shift, perp2));
+  }
+
+  // Values and derivatives with respect to depth
+  //
+  // Derivatives of distance are taken as zero where the distance is
+  // zero, and derivatives of the polar angle where it is 0 or pi.
+
+  UTIL_SIMD_INLINE static ScalarType sin_cycles(ScalarType x) {
+    return util::simd_math::cos_cycles<accuracy>(x - 0.25);
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative radial_with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType decay_square,
+      ScalarType amplitude) {
+    const auto value = 1 / (1 + decay_square * distance2(x, shift, perp2));
+    return {amplitude * value,
+            -2 * amplitude * decay_square * (x + shift) * value * value};
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative sinusoid_with_derivative(
+      ScalarType x, ScalarType frequency, ScalarType phase,
+      ScalarType amplitude) {
+    constexpr ScalarType two_pi = 2 * std::numbers::pi;
+    const auto angle = frequency * x + phase;
+    return {amplitude * util::simd_math::cos_cycles<accuracy>(angle),
+            -two_pi * amplitude * frequency * sin_cycles(angle)};
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative radial_sinusoid_with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType frequency,
+      ScalarType phase, ScalarType amplitude) {
+    constexpr ScalarType two_pi = 2 * std::numbers::pi;
+    const auto r = std::sqrt(distance2(x, shift, perp2));
+    const auto dr = r > 0 ? (x + shift) / r : 0;
+    const auto angle = frequency * r + phase;
+    return {amplitude * util::simd_math::cos_cycles<accuracy>(angle),
+            -two_pi * amplitude * frequency * sin_cycles(angle) * dr};
+  }
+
+  /*! \brief Scale value and derivative by Gaussian factor */
+  UTIL_SIMD_INLINE static ValueAndDerivative band_limit_with_derivative(
+      const ValueAndDerivative& form, ScalarType x, ScalarType rate) {
+    const auto factor = band_limit(x, rate);
+    return {form.value * factor,
+            (form.derivative - 2 * rate * x * form.value) * factor};
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative
+  band_limited_sinusoid_with_derivative(ScalarType x, ScalarType frequency,
+                                        ScalarType phase, ScalarType amplitude,
+                                        ScalarType rate) {
+    return band_limit_with_derivative(
+        sinusoid_with_derivative(x, frequency, phase, amplitude), x, rate);
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative
+  band_limited_radial_sinusoid_with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType frequency,
+      ScalarType phase, ScalarType amplitude, ScalarType rate) {
+    return band_limit_with_derivative(
+        radial_sinusoid_with_derivative(x, shift, perp2, frequency, phase,
+                                        amplitude),
+        x, rate);
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative polar_sinusoid_with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2, ScalarType axial_slope,
+      ScalarType axial_offset, ScalarType radial_frequency,
+      ScalarType polar_frequency, ScalarType phase, ScalarType amplitude) {
+    constexpr ScalarType one = 1;
+    constexpr ScalarType two_pi = 2 * std::numbers::pi;
+    const auto r = std::sqrt(distance2(x, shift, perp2));
+    const auto inv_r = r > 0 ? 1 / r : 0;
+    const auto dr = (x + shift) * inv_r;
+    const auto cos_theta =
+        std::clamp((axial_slope * x + axial_offset) * inv_r, -one, one);
+    const auto sin_theta2 = 1 - cos_theta * cos_theta;
+    const auto dcos_theta = (axial_slope - cos_theta * dr) * inv_r;
+    const auto dtheta =
+        sin_theta2 > 0 ? -dcos_theta / std::sqrt(sin_theta2) : 0;
+    const auto theta = util::simd_math::acos<accuracy>(cos_theta);
+    const auto angle =
+        radial_frequency * r + polar_frequency * theta + phase;
+    return {amplitude * util::simd_math::cos_cycles<accuracy>(angle),
+            -two_pi * amplitude * sin_cycles(angle) *
+                (radial_frequency * dr + polar_frequency * dtheta)};
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative minus_exp_with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2,
+      ScalarType dist_scale_square) {
+    const auto expm1 = util::simd_math::expm1<accuracy>(
+        dist_scale_square * distance2(x, shift, perp2));
+    return {-expm1, -2 * dist_scale_square * (x + shift) * (expm1 + 1)};
+  }
+
+  // Bounds over depth interval [x0,x1]
+  //
+  // Bounds are not widened for approximation errors. Oscillating
+  // forms are not bounded here (see sum_amplitudes).
+
+  UTIL_SIMD_INLINE static Bounds distance2_bounds(
+      ScalarType x0, ScalarType x1, ScalarType shift, ScalarType perp2) {
+    const auto y0 = x0 + shift;
+    const auto y1 = x1 + shift;
+    const auto y0_square = y0 * y0;
+    const auto y1_square = y1 * y1;
+    const auto y_square_min = y0_square < y1_square ? y0_square : y1_square;
+    const auto y_square_max = y0_square < y1_square ? y1_square : y0_square;
+    return {(y0 <= 0 && y1 >= 0 ? 0 : y_square_min) + perp2,
+            y_square_max + perp2};
+  }
+
+  UTIL_SIMD_INLINE static Bounds radial_bounds(
+      ScalarType x0, ScalarType x1, ScalarType shift, ScalarType perp2,
+      ScalarType decay_square, ScalarType amplitude) {
+    const auto [r2_min, r2_max] = distance2_bounds(x0, x1, shift, perp2);
+    const auto outer = amplitude / (1 + decay_square * r2_max);
+    const auto inner = amplitude / (1 + decay_square * r2_min);
+    return {outer < inner ? outer : inner, outer < inner ? inner : outer};
+  }
+
+  UTIL_SIMD_INLINE static Bounds minus_exp_bounds(
+      ScalarType x0, ScalarType x1, ScalarType shift, ScalarType perp2,
+      ScalarType dist_scale_square) {
+    const auto [r2_min, r2_max] = distance2_bounds(x0, x1, shift, perp2);
+    return {-util::simd_math::expm1<accuracy>(dist_scale_square * r2_max),
+            -util::simd_math::expm1<accuracy>(dist_scale_square * r2_min)};
+  }
+};
+
+/*! \brief Metaball kernel of q=r^2/R^2, see MetaballFalloff */
+template <MetaballFalloff falloff>
+UTIL_SIMD_INLINE ScalarType metaball_kernel(ScalarType q) {
+  ScalarType value;
+  if constexpr (falloff == MetaballFalloff::Wyvill) {
+    constexpr ScalarType c1 = -22. / 9, c2 = 17. / 9, c3 = -4. / 9;
+    value = 1 + q * (c1 + q * (c2 + q * c3));
+  } else {
+    const auto a = std::sqrt(q < 1 ? q : 1);
+    value = 1 - a * a * a * (10 + a * (-15 + 6 * a));
+  }
+  return q < 1 ? value : 0;
+}
+
+/*! \brief Derivative of metaball kernel with respect to q */
+template <MetaballFalloff falloff>
+UTIL_SIMD_INLINE ScalarType metaball_kernel_derivative(ScalarType q) {
+  ScalarType value;
+  if constexpr (falloff == MetaballFalloff::Wyvill) {
+    constexpr ScalarType c1 = -22. / 9, c2 = 17. / 9, c3 = -4. / 9;
+    value = c1 + q * (2 * c2 + q * 3 * c3);
+  } else {
+    const auto a = std::sqrt(q < 1 ? q : 1);
+    value = -15 * a * (1 - a) * (1 - a);
+  }
+  return q < 1 ? value : 0;
+}
+
+ScalarType metaball_kernel(ScalarType q, MetaballFalloff falloff) {
+  switch (falloff) {
+    case MetaballFalloff::Wyvill:
+      return metaball_kernel<MetaballFalloff::Wyvill>(q);
+    case MetaballFalloff::Quintic:
+      return metaball_kernel<MetaballFalloff::Quintic>(q);
+  }
+  UTIL_ERROR("Unrecognized metaball falloff (", static_cast<int>(falloff),
+             ")");
+}
+
+/*! \brief 1D metaball forms along ray, see RaySceneElements
+ *
+ * Metaball kernels have no transcendental functions, so these do not
+ * depend on accuracy.
+ */
+template <MetaballFalloff falloff>
+struct MetaballForms {
+  using Distance = RayForms<Accuracy::Full>;
+
+  UTIL_SIMD_INLINE static ScalarType value(ScalarType x, ScalarType shift,
+                                           ScalarType perp2,
+                                           ScalarType inv_radius_square) {
+    return metaball_kernel<falloff>(inv_radius_square *
+                                    Distance::distance2(x, shift, perp2));
+  }
+
+  UTIL_SIMD_INLINE static ValueAndDerivative with_derivative(
+      ScalarType x, ScalarType shift, ScalarType perp2,
+      ScalarType inv_radius_square) {
+    const auto q = inv_radius_square * Distance::distance2(x, shift, perp2);
+    return {metaball_kernel<falloff>(q),
+            2 * inv_radius_square * (x + shift) *
+                metaball_kernel_derivative<falloff>(q)};
+  }
+
+  /*! \brief Bounds over depth interval, since kernels are decreasing */
+  UTIL_SIMD_INLINE static Bounds bounds(ScalarType x0, ScalarType x1,
+                                        ScalarType shift, ScalarType perp2,
+                                        ScalarType inv_radius_square) {
+    const auto [r2_min, r2_max] =
+        Distance::distance2_bounds(x0, x1, shift, perp2);
+    return {metaball_kernel<falloff>(inv_radius_square * r2_max),
+            metaball_kernel<falloff>(inv_radius_square * r2_min)};
+  }
+
+  /*! \brief Depths where kernel is nonzero */
+  static Bounds support(ScalarType shift, ScalarType perp2,
+                        ScalarType inv_radius_square) {
+    const auto half_width =
+        std::sqrt(std::max(1 / inv_radius_square - perp2, ScalarType{0}));
+    return {-shift - half_width, -shift + half_width};
+  }
+};
+
+using WyvillForms = MetaballForms<MetaballFalloff::Wyvill>;
+using QuinticForms = MetaballForms<MetaballFalloff::Quintic>;
+
+/*! \brief Relative error allowed for in score bounds
+ *
+ * Bounds are computed with low accuracy math functions. This covers
+ * their error, as well as the error of scores at any accuracy.
+ */
+constexpr ScalarType bounds_tolerance = 1e-3;
+
+/*! \brief Minimum loop size for SIMD
+ *
+ * Masked SIMD loops over a few elements are slower than scalar
+ * loops.
+ */
+constexpr size_t min_simd_size = 4;
+
+/*! \brief Sum of 1D forms at depth, vectorized over forms */
+template <auto form, typename Forms>
+ScalarType sum_forms(const Forms& forms, ScalarType x) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const size_t size = forms.size();
+  if (size == 0) {
+    return 0;
+  }
+  return [&]<size_t... ks>(std::index_sequence<ks...>) -> ScalarType {
+    const auto params = std::make_tuple(forms.params[ks].data()...);
+    ScalarType result = 0;
+    if (size < min_simd_size) {
+      for (size_t j = 0; j < size; ++j) {
+        result += form(x, std::get<ks>(params)[j]...);
+      }
+      return result;
+    }
+#pragma omp simd reduction(+ : result)
+    for (size_t j = 0; j < size; ++j) {
+      result += form(x, std::get<ks>(params)[j]...);
+    }
+    return result;
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Sum of 1D forms and derivatives at depth
+ *
+ * Vectorized over forms, like sum_forms.
+ */
+template <auto form, typename Forms>
+ValueAndDerivative sum_forms_with_derivative(const Forms& forms,
+                                             ScalarType x) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const size_t size = forms.size();
+  if (size == 0) {
+    return {0, 0};
+  }
+  return [&]<size_t... ks>(std::index_sequence<ks...>) -> ValueAndDerivative {
+    const auto params = std::make_tuple(forms.params[ks].data()...);
+    ScalarType value = 0, derivative = 0;
+    if (size < min_simd_size) {
+      for (size_t j = 0; j < size; ++j) {
+        const auto result = form(x, std::get<ks>(params)[j]...);
+        value += result.value;
+        derivative += result.derivative;
+      }
+      return {value, derivative};
+    }
+#pragma omp simd reduction(+ : value, derivative)
+    for (size_t j = 0; j < size; ++j) {
+      const auto result = form(x, std::get<ks>(params)[j]...);
+      value += result.value;
+      derivative += result.derivative;
+    }
+    return {value, derivative};
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Maximum number of depth intervals bounded together
+ *
+ * Bounds are vectorized over intervals, since there are typically
+ * few of them per ray.
+ */
+constexpr size_t max_bounds_batch_size = 16;
+
+/*! \brief Add bounds of 1D forms over depth intervals
+ *
+ * Accumulates lower and upper bounds, and their magnitudes for
+ * estimating errors.
+ */
+template <auto form_bounds, typename Forms>
+void add_form_bounds(const Forms& forms, size_t batch_size,
+                     const ScalarType* x0, const ScalarType* x1,
+                     ScalarType* lower, ScalarType* upper,
+                     ScalarType* lower_magnitude,
+                     ScalarType* upper_magnitude) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  [&]<size_t... ks>(std::index_sequence<ks...>) {
+    for (size_t j = 0; j < forms.size(); ++j) {
+      const auto params = std::make_tuple(forms.params[ks][j]...);
+#pragma omp simd
+      for (size_t k = 0; k < batch_size; ++k) {
+        const auto [form_lower, form_upper] =
+            form_bounds(x0[k], x1[k], std::get<ks>(params)...);
+        lower[k] += form_lower;
+        upper[k] += form_upper;
+        lower_magnitude[k] += std::abs(form_lower);
+        upper_magnitude[k] += std::abs(form_upper);
+      }
+    }
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Sum of absolute amplitudes of oscillating 1D forms
+ *
+ * Bounds the sum of the forms at any depth.
+ */
+template <size_t amplitude_index, typename Forms>
+ScalarType sum_amplitudes(const Forms& forms) {
+  const auto* amplitudes = forms.params[amplitude_index].data();
+  ScalarType result = 0;
+#pragma omp simd reduction(+ : result)
+  for (size_t j = 0; j < forms.size(); ++j) {
+    result += std::abs(amplitudes[j]);
+  }
+  return result;
+}
+
+/*! \brief Add 1D forms at multiple depths
+ *
+ * Vectorized over depths, or over forms if there are fewer depths.
+ */
+template <auto form, typename Forms>
+void add_forms(const Forms& forms, std::span<const ScalarType> depths,
+               std::span<ScalarType> scores) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const auto* xs = depths.data();
+  auto* out = scores.data();
+  const size_t size = depths.size();
+  if (size < forms.size()) {
+    for (size_t i = 0; i < size; ++i) {
+      out[i] += sum_forms<form>(forms, xs[i]);
+    }
+    return;
+  }
+  [&]<size_t... ks>(std::index_sequence<ks...>) {
+    for (size_t j = 0; j < forms.size(); ++j) {
+      const auto params = std::make_tuple(forms.params[ks][j]...);
+#pragma omp simd
+      for (size_t i = 0; i < size; ++i) {
+        out[i] += form(xs[i], std::get<ks>(params)...);
+      }
+    }
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Add metaball forms at sorted depths
+ *
+ * Each form is only evaluated at depths in its support, so the cost
+ * depends on how many forms overlap each depth.
+ */
+template <typename Form, typename Forms>
+void add_metaball_forms(const Forms& forms,
+                        std::span<const ScalarType> depths,
+                        std::span<ScalarType> scores) {
+  const auto* xs = depths.data();
+  auto* out = scores.data();
+  for (size_t j = 0; j < forms.size(); ++j) {
+    const auto shift = forms.params[0][j];
+    const auto perp2 = forms.params[1][j];
+    const auto inv_radius_square = forms.params[2][j];
+    const auto [x_min, x_max] = Form::support(shift, perp2, inv_radius_square);
+    const size_t begin =
+        std::lower_bound(depths.begin(), depths.end(), x_min) -
+        depths.begin();
+    const size_t end =
+        std::upper_bound(depths.begin() + begin, depths.end(), x_max) -
+        depths.begin();
+#pragma omp simd
+    for (size_t i = begin; i < end; ++i) {
+      out[i] += Form::value(xs[i], shift, perp2, inv_radius_square);
+    }
+  }
+}
+
+/*! \brief Number of band-limited 1D forms not dropped at depth
+ *
+ * Forms must be sorted by rate, which is the last parameter, so that
+ * these are a prefix.
+ */
+template <typename Forms>
+size_t num_band_limited_forms(const Forms& forms, ScalarType x) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const auto& rates = forms.params[num_params - 1];
+  const auto max_rate = band_limit_cutoff / (x * x);
+  return std::lower_bound(rates.begin(), rates.end(), max_rate) -
+         rates.begin();
+}
+
+/*! \brief Sum of band-limited 1D forms at depth
+ *
+ * Vectorized over the forms that are not dropped, like sum_forms.
+ * Returns the sum of values and of resolved variances (see
+ * RayForms::band_limit_with_variance).
+ */
+template <auto form, typename Forms>
+ValueAndVariance sum_band_limited_forms(const Forms& forms, ScalarType x) {
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const size_t size = num_band_limited_forms(forms, x);
+  return [&]<size_t... ks>(std::index_sequence<ks...>) -> ValueAndVariance {
+    const auto params = std::make_tuple(forms.params[ks].data()...);
+    ScalarType value = 0, variance = 0;
+#pragma omp simd reduction(+ : value, variance)
+    for (size_t j = 0; j < size; ++j) {
+      const auto result = form(x, std::get<ks>(params)[j]...);
+      value += result.value;
+      variance += result.variance;
+    }
+    return {value, variance};
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Add band-limited 1D forms at multiple depths
+ *
+ * Resolved variances are added to variances if it is not empty.
+ * Vectorized over depths, or over forms if there are fewer depths,
+ * as in add_forms. Forms must be sorted by rate. If depths are
+ * sorted, the depths where each form is not dropped shrink from
+ * those of the previous form.
+ */
+template <auto form, typename Forms>
+void add_band_limited_forms(const Forms& forms,
+                            std::span<const ScalarType> depths,
+                            bool depths_sorted, std::span<ScalarType> scores,
+                            std::span<ScalarType> variances) {
+  using Form = RayForms<Accuracy::Full>;
+  constexpr size_t num_params = std::tuple_size_v<decltype(forms.params)>;
+  const auto* xs = depths.data();
+  auto* out = scores.data();
+  auto* out_variances = variances.data();
+  if (depths.size() < forms.size()) {
+    for (size_t i = 0; i < depths.size(); ++i) {
+      const auto [value, variance] =
+          sum_band_limited_forms<form>(forms, xs[i]);
+      out[i] += value;
+      if (!variances.empty()) {
+        out_variances[i] += variance;
+      }
+    }
+    return;
+  }
+  size_t begin = 0, end = depths.size();
+  [&]<size_t... ks>(std::index_sequence<ks...>) {
+    for (size_t j = 0; j < forms.size(); ++j) {
+      const auto params = std::make_tuple(forms.params[ks][j]...);
+      if (depths_sorted) {
+        const auto [x_min, x_max] =
+            Form::band_limit_support(forms.params[num_params - 1][j]);
+        while (begin < end && xs[begin] < x_min) {
+          ++begin;
+        }
+        while (end > begin && xs[end - 1] > x_max) {
+          --end;
+        }
+      }
+      if (variances.empty()) {
+#pragma omp simd
+        for (size_t i = begin; i < end; ++i) {
+          out[i] += form(xs[i], std::get<ks>(params)...).value;
+        }
+      } else {
+#pragma omp simd
+        for (size_t i = begin; i < end; ++i) {
+          const auto result = form(xs[i], std::get<ks>(params)...);
+          out[i] += result.value;
+          out_variances[i] += result.variance;
+        }
+      }
+    }
+  }(std::make_index_sequence<num_params>());
+}
+
+/*! \brief Sum of variances of oscillating 1D forms
+ *
+ * Each form has variance amplitude^2/2 over a uniformly distributed
+ * phase.
+ */
+template <size_t amplitude_index, typename Forms>
+ScalarType sum_variances(const Forms& forms) {
+  const auto* amplitudes = forms.params[amplitude_index].data();
+  ScalarType result = 0;
+#pragma omp simd reduction(+ : result)
+  for (size_t j = 0; j < forms.size(); ++j) {
+    result += amplitudes[j] * amplitudes[j] / 2;
+  }
+  return result;
+}
+
+/*! \brief Map from unit interval onto ray segments that need sampling
+ *
+ * Segments are equal intervals of the unit interval (see
+ * Scene::classify_ray_segments). The map returns a point and the
+ * Jacobian of the map, and is the identity if every segment needs
+ * sampling.
+ */
+struct SegmentMap {
+  std::span<const size_t> segments;
+  size_t num_segments;
+
+  bool is_identity() const { return segments.size() == num_segments; }
+
+  std::pair<ScalarType, ScalarType> operator()(const ScalarType& u) const {
+    if (is_identity()) {
+      return {u, 1};
+    }
+    const ScalarType segment_size = ScalarType{1} / num_segments;
+    const auto scaled = u * segments.size();
+    const auto i = std::min(static_cast<size_t>(scaled), segments.size() - 1);
+    return {(segments[i] + (scaled - i)) * segment_size,
+            segments.size() * segment_size};
+  }
+
+  /*! \brief Integral over [u0,u1] of function composed with map
+   *
+   * integral(t0, t1) returns the integral of the function over
+   * [t0,t1]. By a change of variables, the result is the sum over the
+   * images of [u0,u1] in each segment.
+   */
+  template <typename Integral>
+  ScalarType integrate(const ScalarType& u0, const ScalarType& u1,
+                       Integral&& integral) const {
+    if (is_identity()) {
+      return integral(u0, u1);
+    }
+    const ScalarType segment_size = ScalarType{1} / num_segments;
+    const size_t size = segments.size();
+    const auto last = std::min(static_cast<size_t>(u1 * size), size - 1);
+    ScalarType result = 0;
+    for (size_t i = std::min(static_cast<size_t>(u0 * size), size - 1);
+         i <= last; ++i) {
+      const auto v0 = std::max(u0 * size - i, ScalarType{0});
+      const auto v1 = std::min(u1 * size - i, ScalarType{1});
+      if (v0 < v1) {
+        result += integral((segments[i] + v0) * segment_size,
+                           (segments[i] + v1) * segment_size);
+      }
+    }
+    return result;
+  }
+};
+
+/*! \brief Thread-local buffers for evaluating all points on a ray */
+struct RayBuffers {
+  RaySceneElements elements;
+  std::vector<uint32_t> metaballs;
+  std::vector<size_t> uncertain_segments;
+  std::vector<VectorType> positions;
+  std::vector<ScalarType> depths;
+  std::vector<ScalarType> weights;
+  std::vector<ScalarType> densities;
+  std::vector<ScalarType> variances;
+  std::vector<int> levels;
+};
+
+RayBuffers& ray_buffers() {
+  thread_local RayBuffers buffers;
+  return buffers;
+}
+
+}  // namespace
+
 Scene::Scene() {}
 
 Scene::ScalarType Scene::density_threshold() const {
@@ -37,13 +863,74 @@ void Scene::set_density_threshold_width(const ScalarType& threshold_width) {
   density_threshold_width_ = threshold_width;
 }
 
-void Scene::add_element(std::unique_ptr<SceneElement>&& element) {
-  elements_.emplace_back(std::move(element));
+Scene::Accuracy Scene::math_accuracy() const { return math_accuracy_; }
+
+void Scene::set_math_accuracy(Accuracy accuracy) {
+  math_accuracy_ = accuracy;
+  for (auto& element : elements_) {
+    element->set_accuracy(accuracy);
+  }
+  compile_elements();
 }
 
-SceneElement& Scene::get_element(size_t idx) {
-  return const_cast<SceneElement&>(
-      const_cast<const Scene&>(*this).get_element(idx));
+Scene::ScalarType Scene::far_field_theta() const { return far_field_theta_; }
+
+void Scene::set_far_field_theta(const ScalarType& theta) {
+  UTIL_CHECK(theta >= 0, "Invalid far-field theta (", theta, ")");
+  far_field_theta_ = theta;
+  compile_elements();
+}
+
+Scene::ScalarType Scene::nufft_tolerance() const { return nufft_tolerance_; }
+
+void Scene::set_nufft_tolerance(const ScalarType& tolerance) {
+  UTIL_CHECK(tolerance >= 0 && tolerance < 1, "Invalid NUFFT tolerance (",
+             tolerance, ")");
+  nufft_tolerance_ = tolerance;
+}
+
+bool Scene::frequency_lod() const { return frequency_lod_; }
+
+void Scene::set_frequency_lod(bool enabled) { frequency_lod_ = enabled; }
+
+Scene::ScalarType Scene::density_cache_spacing() const {
+  return density_cache_ == nullptr ? 0 : density_cache_->spacing();
+}
+
+void Scene::set_density_cache_spacing(const ScalarType& spacing) {
+  UTIL_CHECK(spacing >= 0, "Invalid density cache spacing (", spacing, ")");
+  if (spacing == 0) {
+    density_cache_.reset();
+  } else {
+    density_cache_ =
+        std::make_unique<util::BrickCache<ndim, ScalarType>>(spacing);
+  }
+}
+
+bool Scene::jit_enabled() const { return jit_enabled_; }
+
+void Scene::set_jit_enabled(bool enabled) {
+  jit_enabled_ = enabled;
+  compile_elements();
+}
+
+bool Scene::jit_ready() const { return jit_kernel() != nullptr; }
+
+void Scene::wait_for_jit() const {
+  if (jit_build_ != nullptr) {
+    jit_build_->wait();
+  }
+}
+
+const jit::DensityKernel* Scene::jit_kernel() const {
+  return jit_build_ == nullptr ? nullptr : jit_build_->kernel();
+}
+
+void Scene::add_element(std::unique_ptr<SceneElement>&& element) {
+  UTIL_CHECK(element != nullptr, "Attempted to add null scene element");
+  element->set_accuracy(math_accuracy_);
+  elements_.emplace_back(std::move(element));
+  compile_elements();
 }
 
 const SceneElement& Scene::get_element(size_t idx) const {
@@ -58,63 +945,1213 @@ void Scene::remove_element(size_t idx) {
   UTIL_CHECK(idx < elements_.size(), "Attempted to remove scene element ", idx,
              ", but there are only ", elements_.size());
   elements_.erase(elements_.begin() + idx);
+  compile_elements();
 }
 
 size_t Scene::num_elements() const { return elements_.size(); }
 
+const std::vector<PackedSceneElement>& Scene::compiled_elements() const {
+  return compiled_elements_;
+}
+
+void Scene::compile_elements() {
+  // Flatten scene elements
+  std::vector<PackedSceneElement> flattened;
+  for (const auto& element : elements_) {
+    pack_element(*element, flattened);
+  }
+
+  // Collect sinusoid components
+  // Note: A lone sinusoid is left as is since its kernel is cheaper
+  // than a multi-sinusoid with one component.
+  std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components;
+  size_t num_sinusoids = 0, num_multi_sinusoids = 0;
+  for (const auto& packed : flattened) {
+    if (const auto* sinusoid = std::get_if<SinusoidSceneElement>(&packed)) {
+      components.emplace_back(sinusoid->wave_vector(), sinusoid->phase(),
+                              sinusoid->amplitude());
+      ++num_sinusoids;
+    }
+    if (const auto* multi_sinusoid =
+            std::get_if<MultiSinusoidSceneElement>(&packed)) {
+      const auto multi_components = multi_sinusoid->components();
+      components.insert(components.end(), multi_components.begin(),
+                        multi_components.end());
+      ++num_multi_sinusoids;
+    }
+  }
+  const bool fuse_sinusoids = num_sinusoids > 1 || num_multi_sinusoids > 0;
+
+  // Collect radial components
+  // Note: As with sinusoids, a lone radial element is left as is.
+  std::vector<MultiRadialSceneElement::Component> radial_components;
+  size_t num_radials = 0, num_multi_radials = 0;
+  for (const auto& packed : flattened) {
+    if (const auto* radial = std::get_if<RadialSceneElement>(&packed)) {
+      radial_components.push_back({radial->center(), radial->decay_square()});
+      ++num_radials;
+    }
+    if (const auto* multi_radial =
+            std::get_if<MultiRadialSceneElement>(&packed)) {
+      radial_components.insert(radial_components.end(),
+                               multi_radial->components().begin(),
+                               multi_radial->components().end());
+      ++num_multi_radials;
+    }
+  }
+  const bool fuse_radials = num_radials > 1 || num_multi_radials > 0;
+
+  // Collect metaballs
+  std::vector<MetaballSceneElement::Metaball> metaballs;
+  for (const auto& packed : flattened) {
+    if (const auto* element = std::get_if<MetaballSceneElement>(&packed)) {
+      metaballs.insert(metaballs.end(), element->metaballs().begin(),
+                       element->metaballs().end());
+    }
+  }
+
+  // Keep previous fused metaballs, so that their grid can be updated
+  std::optional<MetaballSceneElement> fused_metaballs;
+  for (auto& packed : compiled_elements_) {
+    if (auto* element = std::get_if<MetaballSceneElement>(&packed)) {
+      fused_metaballs = std::move(*element);
+    }
+  }
+
+  // Drop elements that are zero everywhere and fused elements
+  compiled_elements_.clear();
+  for (auto& packed : flattened) {
+    const bool is_sinusoid =
+        std::holds_alternative<SinusoidSceneElement>(packed) ||
+        std::holds_alternative<MultiSinusoidSceneElement>(packed);
+    const bool is_radial =
+        std::holds_alternative<RadialSceneElement>(packed) ||
+        std::holds_alternative<MultiRadialSceneElement>(packed);
+    const bool is_metaball =
+        std::holds_alternative<MetaballSceneElement>(packed);
+    const bool is_zero = std::visit(
+        [](const auto& element) -> bool {
+          using ElementType = std::decay_t<decltype(element)>;
+          return element.ElementType::is_zero();
+        },
+        packed);
+    if (!is_zero && !(fuse_sinusoids && is_sinusoid) &&
+        !(fuse_radials && is_radial) && !is_metaball) {
+      compiled_elements_.emplace_back(std::move(packed));
+    }
+  }
+
+  // Fuse sinusoids into one multi-sinusoid
+  // Note: Components are sorted by wavenumber, so that band-limited
+  // rays do not need to sort them (see
+  // RaySceneElements::sort_band_limited).
+  if (fuse_sinusoids) {
+    std::erase_if(components, [](const auto& component) -> bool {
+      return std::get<2>(component) == 0;
+    });
+    std::stable_sort(components.begin(), components.end(),
+                     [](const auto& a, const auto& b) -> bool {
+                       return std::get<0>(a).norm2() < std::get<0>(b).norm2();
+                     });
+    if (!components.empty()) {
+      MultiSinusoidSceneElement fused(components);
+      fused.set_accuracy(math_accuracy_);
+      compiled_elements_.emplace_back(std::move(fused));
+    }
+  }
+
+  // Fuse radial elements into one multi-radial
+  if (fuse_radials && !radial_components.empty()) {
+    MultiRadialSceneElement fused(std::move(radial_components),
+                                  far_field_theta_);
+    fused.set_accuracy(math_accuracy_);
+    compiled_elements_.emplace_back(std::move(fused));
+  }
+
+  // Fuse metaballs into one element
+  // Note: Metaballs after the first change are removed and appended
+  // again, so adding or removing the last scene element only updates
+  // the grid for its own metaballs.
+  if (!metaballs.empty()) {
+    if (!fused_metaballs) {
+      fused_metaballs.emplace();
+    }
+    const auto& previous = fused_metaballs->metaballs();
+    const auto mismatch = std::mismatch(
+        previous.begin(), previous.end(), metaballs.begin(), metaballs.end(),
+        [](const auto& a, const auto& b) -> bool {
+          return std::equal(a.center.begin(), a.center.end(),
+                            b.center.begin()) &&
+                 a.radius == b.radius && a.falloff == b.falloff;
+        });
+    const size_t num_unchanged = mismatch.first - previous.begin();
+    fused_metaballs->truncate(num_unchanged);
+    fused_metaballs->append(std::span(metaballs).subspan(num_unchanged));
+    compiled_elements_.emplace_back(std::move(*fused_metaballs));
+  }
+
+  // Group elements by type
+  std::stable_sort(
+      compiled_elements_.begin(), compiled_elements_.end(),
+      [](const PackedSceneElement& a, const PackedSceneElement& b) {
+        return a.index() < b.index();
+      });
+
+  // Invalidate density cache
+  if (density_cache_ != nullptr) {
+    density_cache_->clear();
+  }
+
+  // Build JIT kernel
+  // Note: Discarding the previous build cancels it if it has not
+  // started compiling.
+  // Note: Metaballs are not compiled, since a kernel would sum every
+  // metaball at every position instead of looking up the nearby ones
+  // in their grid. Radial elements with far field approximation are
+  // not compiled, since a kernel would sum every center exactly. Scenes
+  // with more than jit::max_source_terms terms are not compiled either.
+  jit_build_.reset();
+  const bool has_grid_or_tree = std::any_of(
+      compiled_elements_.begin(), compiled_elements_.end(),
+      [](const PackedSceneElement& packed) -> bool {
+        if (std::holds_alternative<MetaballSceneElement>(packed)) {
+          return true;
+        }
+        const auto* radial = std::get_if<MultiRadialSceneElement>(&packed);
+        return radial != nullptr && radial->far_field_theta() > 0;
+      });
+  if (jit_enabled_ && !has_grid_or_tree) {
+    if (auto source =
+            jit::generate_source(compiled_elements_, math_accuracy_)) {
+      jit_build_ = jit::build_kernel(std::move(*source));
+    }
+  }
+}
+
+Scene::ScalarType Scene::compute_score(const VectorType& position) const {
+  ScalarType score = 0;
+  for (const auto& packed : compiled_elements_) {
+    score += std::visit(
+        [&position](const auto& element) -> ScalarType {
+          using ElementType = std::decay_t<decltype(element)>;
+          return element.ElementType::operator()(position);
+        },
+        packed);
+  }
+  return score;
+}
+
 Scene::ScalarType Scene::compute_density(const VectorType& position) const {
+  return apply_density_threshold(compute_score(position));
+}
+
+void Scene::compute_scores(std::span<const VectorType> positions,
+                           std::span<ScalarType> scores) const {
+  UTIL_CHECK(positions.size() == scores.size(), "Attempted to compute ",
+             positions.size(), " scores into ", scores.size(), " outputs");
+  if (const auto* kernel = jit_kernel()) {
+    kernel->compute_scores(positions, scores);
+    return;
+  }
+  if (compiled_elements_.empty()) {
+    std::fill(scores.begin(), scores.end(), 0);
+    return;
+  }
+  for (size_t i = 0; i < compiled_elements_.size(); ++i) {
+    std::visit(
+        [&](const auto& element) {
+          using ElementType = std::decay_t<decltype(element)>;
+          element.ElementType::evaluate(positions, scores, i > 0);
+        },
+        compiled_elements_[i]);
+  }
+}
+
+void Scene::compute_densities(std::span<const VectorType> positions,
+                              std::span<ScalarType> densities) const {
+  if (const auto* kernel = jit_kernel()) {
+    kernel->compute_densities(positions, densities, density_threshold_,
+                              density_threshold_width_);
+    return;
+  }
+  compute_scores(positions, densities);
+  apply_density_threshold(densities);
+}
+
+void Scene::restrict_to_ray(const VectorType& origin,
+                            const VectorType& direction,
+                            const ScalarType& footprint,
+                            RaySceneElements& ray) const {
+  ray.reset(math_accuracy_, nufft_tolerance_,
+            frequency_lod_ ? footprint : 0.);
+  for (const auto& packed : compiled_elements_) {
+    std::visit(
+        [&](const auto& element) {
+          using ElementType = std::decay_t<decltype(element)>;
+          element.ElementType::restrict_to_ray(origin, direction, ray);
+        },
+        packed);
+  }
+  ray.sort_band_limited();
+}
+
+void Scene::compute_ray_densities(const VectorType& origin,
+                                  const VectorType& direction,
+                                  const RaySceneElements& elements,
+                                  std::span<const ScalarType> depths,
+                                  std::span<ScalarType> densities) const {
+  if (density_cache_ != nullptr) {
+    interpolate_ray_scores(origin, direction, depths, densities);
+    apply_density_threshold(densities);
+    return;
+  }
+
+  // Note: JIT kernels evaluate positions, so they are not used for
+  // band-limited elements.
+  if (elements.band_limited()) {
+    auto& variances = ray_buffers().variances;
+    variances.resize(depths.size());
+    elements.compute_scores(depths, densities, variances);
+    apply_density_threshold(densities, variances);
+    return;
+  }
+  if (const auto* kernel = jit_kernel()) {
+    auto& positions = ray_buffers().positions;
+    positions.resize(depths.size());
+    for (size_t i = 0; i < depths.size(); ++i) {
+      positions[i] = origin + depths[i] * direction;
+    }
+    kernel->compute_densities(positions, densities, density_threshold_,
+                              density_threshold_width_);
+    return;
+  }
+  elements.compute_scores(depths, densities);
+  apply_density_threshold(densities);
+}
+
+void Scene::interpolate_ray_scores(const VectorType& origin,
+                                   const VectorType& direction,
+                                   std::span<const ScalarType> depths,
+                                   std::span<ScalarType> scores) const {
+  // Sample positions and levels of detail
+  // Note: Samples are about footprint*depth wide, so cells can grow
+  // with depth without losing detail that is resolved.
+  auto& buffers = ray_buffers();
+  buffers.positions.resize(depths.size());
+  buffers.levels.resize(depths.size());
+  for (size_t i = 0; i < depths.size(); ++i) {
+    const auto& x = depths[i];
+    buffers.positions[i] = origin + x * direction;
+    buffers.levels[i] = x <= density_cache_near_depth
+                            ? 0
+                            : std::ilogb(x / density_cache_near_depth) + 1;
+  }
+
+  // Interpolate cached scores
+  density_cache_->interpolate(
+      buffers.positions, buffers.levels, scores,
+      [this](std::span<const VectorType> nodes, std::span<ScalarType> values) {
+        compute_scores(nodes, values);
+      });
+}
+
+void Scene::apply_density_threshold(
+    std::span<ScalarType> scores, std::span<const ScalarType> variances) const {
+  const auto threshold = density_threshold_;
+  const auto width = density_threshold_width_;
+  if (!variances.empty()) {
+    util::simd_math::dispatch(math_accuracy_, [&]<Accuracy accuracy>() {
+      constexpr ScalarType inf = std::numeric_limits<ScalarType>::infinity();
+      constexpr ScalarType pi = std::numbers::pi;
+      const size_t size = scores.size();
+      auto* data = scores.data();
+      const auto* variance_data = variances.data();
+#pragma omp simd
+      for (size_t i = 0; i < size; ++i) {
+        const auto total_width =
+            std::sqrt(width * width + pi / 8 * variance_data[i]);
+        const auto x = total_width > 0 ? (data[i] - threshold) / total_width
+                       : data[i] >= threshold ? inf
+                                              : -inf;
+        data[i] = util::simd_math::sigmoid<accuracy>(x);
+      }
+    });
+    return;
+  }
+  if (width == 0) {
+    for (auto& score : scores) {
+      score = score >= threshold ? 1. : 0.;
+    }
+    return;
+  }
+  util::simd_math::dispatch(math_accuracy_, [&]<Accuracy accuracy>() {
+    const size_t size = scores.size();
+    auto* data = scores.data();
+#pragma omp simd
+    for (size_t i = 0; i < size; ++i) {
+      data[i] =
+          util::simd_math::sigmoid<accuracy>((data[i] - threshold) / width);
+    }
+  });
+}
+
+Scene::ScalarType Scene::apply_density_threshold(
+    const ScalarType& score, const ScalarType& variance) const {
+  constexpr ScalarType pi = std::numbers::pi;
+  const auto width =
+      variance > 0 ? std::sqrt(density_threshold_width_ *
+                                   density_threshold_width_ +
+                               pi / 8 * variance)
+                   : density_threshold_width_;
+  if (width == 0) {
+    return score >= density_threshold_ ? 1. : 0.;
+  }
+  const auto x = (score - density_threshold_) / width;
+  return util::simd_math::dispatch(
+      math_accuracy_, [x]<Accuracy accuracy>() -> ScalarType {
+        return util::simd_math::sigmoid<accuracy>(x);
+      });
+}
+
+Scene::ScalarType Scene::apply_surrogate_threshold(
+    const ScalarType& score, const ScalarType& variance) const {
+  constexpr ScalarType pi = std::numbers::pi;
+  const auto base_width =
+      std::max(density_threshold_width_, surrogate_threshold_width);
+  const auto width = std::sqrt(base_width * base_width + pi / 8 * variance);
+  const auto x = (score - density_threshold_) / width;
+  return util::simd_math::dispatch(
+      math_accuracy_, [x]<Accuracy accuracy>() -> ScalarType {
+        return util::simd_math::sigmoid<accuracy>(x);
+      });
+}
+
+std::optional<Scene::IntegrationPlan> Scene::make_integration_plan(
+    const Integrator& integrator) {
+  const auto rule = integrator.quadrature_rule();
+  if (!rule) {
+    return std::nullopt;
+  }
+  IntegrationPlan plan;
+  plan.segment_offsets.assign(num_ray_segments + 1, 0);
+  for (size_t k = 0; k < num_ray_segments; ++k) {
+    for (size_t i = 0; i < rule->nodes.size(); ++i) {
+      const auto& node = rule->nodes[i];
+      const auto segment = std::min(
+          static_cast<size_t>(node * num_ray_segments), num_ray_segments - 1);
+      if (segment != k) {
+        continue;
+      }
+      const auto [depth, weight] = ray_depth_and_weight(node);
+      const auto combined_weight = weight * rule->weights[i];
+      if (combined_weight != 0) {
+        plan.depths.push_back(depth);
+        plan.weights.push_back(combined_weight);
+      }
+    }
+    plan.segment_offsets[k + 1] = plan.depths.size();
+  }
+  return plan;
+}
+
+Scene::ScalarType Scene::trace_ray(const VectorType& origin,
+                                   const VectorType& orientation,
+                                   const Integrator& integrator,
+                                   const ScalarType& footprint) const {
+  // Normalize ray orientation
+  UTIL_CHECK(orientation.norm2() > 0, "Invalid orientation (",
+             static_cast<VectorType::ContainerType>(orientation), ")");
+  const auto orientation_unit = orientation.unit();
+
+  // Project scene elements onto ray and integrate segments with
+  // known density
+  auto& buffers = ray_buffers();
+  const auto known_integral = prepare_ray(origin, orientation_unit, footprint,
+                                          buffers.elements,
+                                          buffers.uncertain_segments);
+  if (buffers.uncertain_segments.empty()) {
+    return known_integral;
+  }
+
+  // Function to integrate over remaining segments
+  const SegmentMap segment_map{buffers.uncertain_segments, num_ray_segments};
+  struct RayIntegrand {
+    const Scene& scene;
+    const VectorType& origin;
+    const VectorType& direction;
+    const RaySceneElements& elements;
+    const SegmentMap& segment_map;
+    size_t& num_samples;
+
+    std::pair<ScalarType, ScalarType> depth_and_weight(
+        const ScalarType& u) const {
+      ++num_samples;
+      const auto [t, jacobian] = segment_map(u);
+      const auto [x, weight] = ray_depth_and_weight(t);
+      return {x, jacobian * weight};
+    }
+
+    std::pair<ScalarType, ScalarType> score_and_variance(
+        const ScalarType& x) const {
+      if (scene.density_cache_ != nullptr) {
+        ScalarType score;
+        scene.interpolate_ray_scores(origin, direction, {&x, 1}, {&score, 1});
+        return {score, 0};
+      }
+      return elements.compute_score_and_variance(x);
+    }
+
+    ScalarType operator()(const ScalarType& u) const {
+      const auto [x, weight] = depth_and_weight(u);
+      const auto [score, variance] = score_and_variance(x);
+      return weight * scene.apply_density_threshold(score, variance);
+    }
+
+    // Level set where score is above a hard density threshold
+    // Note: Band-limited elements smooth the threshold, and cached
+    // scores are not restricted to the ray.
+
+    bool has_level_set() const {
+      return scene.density_threshold_width_ == 0 &&
+             !elements.band_limited() && scene.density_cache_ == nullptr;
+    }
+
+    std::pair<ScalarType, ScalarType> level(const ScalarType& u) const {
+      ++num_samples;
+      const auto [t, jacobian] = segment_map(u);
+      const auto x = ray_depth_and_weight(t).first;
+      const auto [score, derivative] = elements.compute_score_and_derivative(x);
+      return {score - scene.density_threshold_,
+              derivative * ray_depth_derivative(t) * jacobian};
+    }
+
+    ScalarType weight_integral(const ScalarType& u0,
+                               const ScalarType& u1) const {
+      return segment_map.integrate(u0, u1, ray_kernel_integral);
+    }
+
+    ScalarType surrogate(const ScalarType& u) const {
+      const auto [x, weight] = depth_and_weight(u);
+      const auto [score, variance] = score_and_variance(x);
+      return weight * scene.apply_surrogate_threshold(score, variance);
+    }
+
+    std::pair<ScalarType, ScalarType> with_surrogate(
+        const ScalarType& u) const {
+      const auto [x, weight] = depth_and_weight(u);
+      const auto [score, variance] = score_and_variance(x);
+      return {weight * scene.apply_density_threshold(score, variance),
+              weight * scene.apply_surrogate_threshold(score, variance)};
+    }
+
+    void evaluate(std::span<const ScalarType> us,
+                  std::span<ScalarType> out) const {
+      auto& buffers = ray_buffers();
+      buffers.depths.resize(us.size());
+      buffers.weights.resize(us.size());
+      for (size_t i = 0; i < us.size(); ++i) {
+        const auto [x, weight] = depth_and_weight(us[i]);
+        buffers.depths[i] = x;
+        buffers.weights[i] = weight;
+      }
+      scene.compute_ray_densities(origin, direction, elements,
+                                  buffers.depths, out);
+      for (size_t i = 0; i < us.size(); ++i) {
+        out[i] *= buffers.weights[i];
+      }
+    }
+  };
+
+  size_t num_samples = 0;
+  const auto result =
+      integrator(RayIntegrand{*this, origin, orientation_unit,
+                              buffers.elements, segment_map, num_samples});
+  num_ray_samples_->fetch_add(num_samples, std::memory_order_relaxed);
+  return known_integral + result;
+}
+
+Scene::ScalarType Scene::trace_ray(const VectorType& origin,
+                                   const VectorType& orientation,
+                                   const IntegrationPlan& plan,
+                                   const ScalarType& footprint) const {
+  // Normalize ray orientation
+  UTIL_CHECK(orientation.norm2() > 0, "Invalid orientation (",
+             static_cast<VectorType::ContainerType>(orientation), ")");
+  const auto orientation_unit = orientation.unit();
+
+  // Project scene elements onto ray and integrate segments with
+  // known density
+  auto& buffers = ray_buffers();
+  const auto known_integral = prepare_ray(origin, orientation_unit, footprint,
+                                          buffers.elements,
+                                          buffers.uncertain_segments);
+  if (buffers.uncertain_segments.empty()) {
+    return known_integral;
+  }
+
+  // Sample depths and weights
+  // Note: Planned depths and weights can be used directly if every
+  // segment is sampled. Otherwise only nodes in the remaining
+  // segments are sampled.
+  std::span<const ScalarType> depths = plan.depths;
+  std::span<const ScalarType> weights = plan.weights;
+  if (buffers.uncertain_segments.size() < num_ray_segments) {
+    buffers.depths.clear();
+    buffers.weights.clear();
+    for (const auto& segment : buffers.uncertain_segments) {
+      const auto begin = plan.segment_offsets[segment];
+      const auto end = plan.segment_offsets[segment + 1];
+      buffers.depths.insert(buffers.depths.end(), &plan.depths[begin],
+                            &plan.depths[end]);
+      buffers.weights.insert(buffers.weights.end(), &plan.weights[begin],
+                             &plan.weights[end]);
+    }
+    depths = buffers.depths;
+    weights = buffers.weights;
+  }
+
+  // Weighted sum of densities
+  num_ray_samples_->fetch_add(depths.size(), std::memory_order_relaxed);
+  buffers.densities.resize(depths.size());
+  compute_ray_densities(origin, orientation_unit, buffers.elements, depths,
+                        buffers.densities);
+  ScalarType result = 0;
+  for (size_t i = 0; i < depths.size(); ++i) {
+    result += weights[i] * buffers.densities[i];
+  }
+  return known_integral + result;
+}
+
+void Scene::sample_ray(const VectorType& origin, const VectorType& orientation,
+                       const IntegrationPlan& plan,
+                       std::span<ScalarType> densities,
+                       const ScalarType& footprint) const {
+  UTIL_CHECK(densities.size() == plan.depths.size(), "Attempted to sample ",
+             plan.depths.size(), " nodes into ", densities.size(), " outputs");
+
+  // Normalize ray orientation
+  UTIL_CHECK(orientation.norm2() > 0, "Invalid orientation (",
+             static_cast<VectorType::ContainerType>(orientation), ")");
+  const auto orientation_unit = orientation.unit();
+
+  // Project scene elements onto ray and fill segments with known
+  // density
+  auto& buffers = ray_buffers();
+  std::array<ScalarType, num_ray_segments> segment_densities;
+  prepare_ray(origin, orientation_unit, footprint, buffers.elements,
+              buffers.uncertain_segments, segment_densities);
+  const auto& uncertain = buffers.uncertain_segments;
+  for (size_t k = 0, next = 0; k < num_ray_segments; ++k) {
+    if (next < uncertain.size() && uncertain[next] == k) {
+      ++next;
+      continue;
+    }
+    std::fill(densities.begin() + plan.segment_offsets[k],
+              densities.begin() + plan.segment_offsets[k + 1],
+              segment_densities[k]);
+  }
+
+  // Sample runs of consecutive uncertain segments
+  const std::span<const ScalarType> depths = plan.depths;
+  for (size_t next = 0; next < uncertain.size();) {
+    size_t last = next;
+    while (last + 1 < uncertain.size() &&
+           uncertain[last + 1] == uncertain[last] + 1) {
+      ++last;
+    }
+    const auto begin = plan.segment_offsets[uncertain[next]];
+    const auto end = plan.segment_offsets[uncertain[last] + 1];
+    num_ray_samples_->fetch_add(end - begin, std::memory_order_relaxed);
+    compute_ray_densities(origin, orientation_unit, buffers.elements,
+                          depths.subspan(begin, end - begin),
+                          densities.subspan(begin, end - begin));
+    next = last + 1;
+  }
+}
+
+size_t Scene::take_num_ray_samples() const {
+  return num_ray_samples_->exchange(0, std::memory_order_relaxed);
+}
+
+std::pair<Scene::ScalarType, Scene::ScalarType> Scene::ray_depth_and_weight(
+    const ScalarType& t_) {
+  // Decay factor
+  // Note: Define s = x/x0 and apply decay of C*s*exp(-s). The decay
+  // peaks at x=x0, i.e. s=1. With C=1, the integral of the decay over
+  // [0,inf) is 1.
+  const ScalarType x0 = ray_depth_scale;
+  auto decay = [](const ScalarType& s) -> ScalarType {
+    return s * util::simd_math::exp(-s);
+  };
+
+  // Integral reparametrization factor
+  // Note: In order to convert integral over [0,inf) to integral over
+  // [0,1], reparametrize s=t/(1-t). This has x=x0 at
+  // t=0.5. This reparametrization requires applying x'(t).
+  auto ds = [](const ScalarType& t) -> ScalarType {
+    const auto tm1 = t - 1;
+    return 1 / (tm1 * tm1);
+  };
+
+  constexpr ScalarType max = 1 - std::numeric_limits<ScalarType>::epsilon() / 2;
+  const auto t = std::min(t_, max);
+  const auto s = t / (1 - t);
+  return {s * x0, x0 * decay(s) * ds(t)};
+}
+
+Scene::ScalarType Scene::ray_depth_derivative(const ScalarType& t_) {
+  // Note: Clamped like ray_depth_and_weight.
+  constexpr ScalarType max = 1 - std::numeric_limits<ScalarType>::epsilon() / 2;
+  const auto t = std::min(t_, max);
+  const auto tm1 = t - 1;
+  return ray_depth_scale / (tm1 * tm1);
+}
+
+Scene::ScalarType Scene::ray_kernel_integral(const ScalarType& t0,
+                                             const ScalarType& t1) {
+  // Note: The decay kernel x0*s*exp(-s) has antiderivative
+  // -x0*(1+s)*exp(-s) with respect to s.
+  auto antiderivative = [](const ScalarType& t) -> ScalarType {
+    const auto s = ray_depth_and_weight(t).first / ray_depth_scale;
+    return -ray_depth_scale * (1 + s) * util::simd_math::exp(-s);
+  };
+  return antiderivative(t1) - antiderivative(t0);
+}
+
+Scene::ScalarType Scene::prepare_ray(
+    const VectorType& origin, const VectorType& direction,
+    const ScalarType& footprint, RaySceneElements& elements,
+    std::vector<size_t>& uncertain_segments,
+    std::span<ScalarType> segment_densities) const {
+  if (density_cache_ != nullptr) {
+    elements.reset(math_accuracy_);
+    uncertain_segments.clear();
+    for (size_t k = 0; k < num_ray_segments; ++k) {
+      uncertain_segments.push_back(k);
+    }
+    return 0;
+  }
+  restrict_to_ray(origin, direction, footprint, elements);
+  return classify_ray_segments(elements, uncertain_segments,
+                               segment_densities);
+}
+
+Scene::ScalarType Scene::classify_ray_segments(
+    const RaySceneElements& elements, std::vector<size_t>& uncertain_segments,
+    std::span<ScalarType> segment_densities) const {
+  uncertain_segments.clear();
+  if (density_threshold_width_ != 0 || elements.band_limited()) {
+    for (size_t k = 0; k < num_ray_segments; ++k) {
+      uncertain_segments.push_back(k);
+    }
+    return 0;
+  }
+
+  // Segment edges and kernel integrals are the same for every ray
+  using SegmentArray = std::array<ScalarType, num_ray_segments>;
+  static const auto [edges, kernel_integrals] = [] {
+    std::array<ScalarType, num_ray_segments + 1> edges;
+    SegmentArray kernel_integrals;
+    constexpr ScalarType segment_size = ScalarType{1} / num_ray_segments;
+    for (size_t k = 0; k <= num_ray_segments; ++k) {
+      edges[k] = ray_depth_and_weight(k * segment_size).first;
+    }
+    for (size_t k = 0; k < num_ray_segments; ++k) {
+      kernel_integrals[k] =
+          ray_kernel_integral(k * segment_size, (k + 1) * segment_size);
+    }
+    return std::make_pair(edges, kernel_integrals);
+  }();
+
+  // Compare score bounds with threshold
+  SegmentArray lower, upper;
+  elements.compute_score_bounds(edges, lower, upper);
+  ScalarType integral = 0;
+  for (size_t k = 0; k < num_ray_segments; ++k) {
+    if (lower[k] >= density_threshold_) {
+      integral += kernel_integrals[k];
+      if (!segment_densities.empty()) {
+        segment_densities[k] = 1;
+      }
+    } else if (!(upper[k] < density_threshold_)) {
+      uncertain_segments.push_back(k);
+    } else if (!segment_densities.empty()) {
+      segment_densities[k] = 0;
+    }
+  }
+  return integral;
+}
+
+template <size_t num_params>
+size_t RaySceneElements::Forms<num_params>::size() const {
+  return params[0].size();
+}
+
+template <size_t num_params>
+void RaySceneElements::Forms<num_params>::clear() {
+  for (auto& values : params) {
+    values.clear();
+  }
+}
+
+template <size_t num_params>
+void RaySceneElements::Forms<num_params>::push_back(
+    const std::array<ScalarType, num_params>& values) {
+  for (size_t k = 0; k < num_params; ++k) {
+    params[k].push_back(values[k]);
+  }
+}
+
+template <size_t num_params>
+std::array<std::span<RaySceneElements::ScalarType>, num_params>
+RaySceneElements::Forms<num_params>::append(size_t count) {
+  std::array<std::span<ScalarType>, num_params> spans;
+  for (size_t k = 0; k < num_params; ++k) {
+    const size_t start = params[k].size();
+    params[k].resize(start + count);
+    spans[k] = std::span(params[k]).subspan(start);
+  }
+  return spans;
+}
+
+template <size_t num_params>
+void RaySceneElements::Forms<num_params>::sort_by(size_t index) {
+  const auto& keys = params[index];
+  if (std::is_sorted(keys.begin(), keys.end())) {
+    return;
+  }
+  std::vector<size_t> order(size());
+  for (size_t j = 0; j < order.size(); ++j) {
+    order[j] = j;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+  std::vector<ScalarType> sorted(order.size());
+  for (auto& values : params) {
+    for (size_t j = 0; j < order.size(); ++j) {
+      sorted[j] = values[order[j]];
+    }
+    values.swap(sorted);
+  }
+}
+
+void RaySceneElements::reset(Accuracy accuracy, ScalarType nufft_tolerance,
+                             ScalarType footprint) {
+  accuracy_ = accuracy;
+  nufft_tolerance_ = nufft_tolerance;
+  footprint_ = footprint;
+  radials_.clear();
+  polynomial_coefficients_.clear();
+  polynomial_offsets_.resize(1);
+  sinusoids_.clear();
+  band_limited_sinusoids_.clear();
+  radial_sinusoids_.clear();
+  band_limited_radial_sinusoids_.clear();
+  polar_sinusoids_.clear();
+  minus_exps_.clear();
+  wyvill_metaballs_.clear();
+  quintic_metaballs_.clear();
+  band_limited_sorted_ = true;
+}
+
+size_t RaySceneElements::num_elements() const {
+  return radials_.size() + (polynomial_offsets_.size() - 1) +
+         sinusoids_.size() + band_limited_sinusoids_.size() +
+         radial_sinusoids_.size() + band_limited_radial_sinusoids_.size() +
+         polar_sinusoids_.size() + minus_exps_.size() +
+         wyvill_metaballs_.size() + quintic_metaballs_.size();
+}
+
+RaySceneElements::ScalarType RaySceneElements::footprint() const {
+  return footprint_;
+}
+
+void RaySceneElements::sort_band_limited() {
+  band_limited_sinusoids_.sort_by(3);
+  band_limited_radial_sinusoids_.sort_by(5);
+  band_limited_sorted_ = true;
+}
+
+bool RaySceneElements::band_limited() const {
+  return band_limited_sinusoids_.size() +
+             band_limited_radial_sinusoids_.size() >
+         0;
+}
+
+void RaySceneElements::check_band_limited_sorted() const {
+  UTIL_CHECK(band_limited_sorted_,
+             "Attempted to evaluate band-limited forms before sorting them");
+}
+
+RaySceneElements::ScalarType RaySceneElements::band_limited_variance() const {
+  return sum_variances<2>(band_limited_sinusoids_) +
+         sum_variances<4>(band_limited_radial_sinusoids_);
+}
+
+RaySceneElements::ScalarType RaySceneElements::band_limit_rate(
+    ScalarType wavenumber_square) const {
+  constexpr ScalarType pi = std::numbers::pi;
+  return pi * pi / 2 * footprint_ * footprint_ * wavenumber_square;
+}
+
+void RaySceneElements::add_radial(ScalarType shift, ScalarType perp2,
+                                  ScalarType decay_square,
+                                  ScalarType amplitude) {
+  radials_.push_back({shift, perp2, decay_square, amplitude});
+}
+
+void RaySceneElements::add_polynomial(
+    std::span<const ScalarType> coefficients) {
+  UTIL_CHECK(!coefficients.empty(), "Attempted to add empty polynomial");
+  polynomial_coefficients_.insert(polynomial_coefficients_.end(),
+                                  coefficients.begin(), coefficients.end());
+  polynomial_offsets_.push_back(polynomial_coefficients_.size());
+}
+
+void RaySceneElements::add_sinusoid(ScalarType frequency, ScalarType phase,
+                                    ScalarType amplitude) {
+  sinusoids_.push_back({frequency, phase, amplitude});
+}
+
+std::array<std::span<RaySceneElements::ScalarType>, 3>
+RaySceneElements::add_sinusoids(size_t count) {
+  return sinusoids_.append(count);
+}
+
+void RaySceneElements::add_band_limited_sinusoid(ScalarType frequency,
+                                                 ScalarType phase,
+                                                 ScalarType amplitude,
+                                                 ScalarType rate) {
+  band_limited_sinusoids_.push_back({frequency, phase, amplitude, rate});
+  band_limited_sorted_ = false;
+}
+
+std::array<std::span<RaySceneElements::ScalarType>, 4>
+RaySceneElements::add_band_limited_sinusoids(size_t count) {
+  band_limited_sorted_ = false;
+  return band_limited_sinusoids_.append(count);
+}
+
+void RaySceneElements::add_radial_sinusoid(ScalarType shift, ScalarType perp2,
+                                           ScalarType frequency,
+                                           ScalarType phase,
+                                           ScalarType amplitude) {
+  radial_sinusoids_.push_back({shift, perp2, frequency, phase, amplitude});
+}
+
+void RaySceneElements::add_band_limited_radial_sinusoid(
+    ScalarType shift, ScalarType perp2, ScalarType frequency,
+    ScalarType phase, ScalarType amplitude, ScalarType rate) {
+  band_limited_radial_sinusoids_.push_back(
+      {shift, perp2, frequency, phase, amplitude, rate});
+  band_limited_sorted_ = false;
+}
+
+void RaySceneElements::add_polar_sinusoid(
+    ScalarType shift, ScalarType perp2, ScalarType axial_slope,
+    ScalarType axial_offset, ScalarType radial_frequency,
+    ScalarType polar_frequency, ScalarType phase, ScalarType amplitude) {
+  polar_sinusoids_.push_back({shift, perp2, axial_slope, axial_offset,
+                              radial_frequency, polar_frequency, phase,
+                              amplitude});
+}
+
+void RaySceneElements::add_minus_exp(ScalarType shift, ScalarType perp2,
+                                     ScalarType dist_scale_square) {
+  minus_exps_.push_back({shift, perp2, dist_scale_square});
+}
+
+void RaySceneElements::add_metaball(ScalarType shift, ScalarType perp2,
+                                    ScalarType inv_radius_square,
+                                    MetaballFalloff falloff) {
+  auto& forms = falloff == MetaballFalloff::Wyvill ? wyvill_metaballs_
+                                                   : quintic_metaballs_;
+  forms.push_back({shift, perp2, inv_radius_square});
+}
+
+RaySceneElements::ScalarType RaySceneElements::compute_score(
+    ScalarType depth) const {
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return compute_score_impl<accuracy>(depth);
+      });
+}
+
+std::pair<RaySceneElements::ScalarType, RaySceneElements::ScalarType>
+RaySceneElements::compute_score_and_variance(ScalarType depth) const {
+  ScalarType variance = 0;
+  const auto score = util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return compute_score_impl<accuracy>(depth, &variance);
+      });
+  return {score, variance};
+}
+
+std::pair<RaySceneElements::ScalarType, RaySceneElements::ScalarType>
+RaySceneElements::compute_score_and_derivative(ScalarType depth) const {
+  return util::simd_math::dispatch(
+      accuracy_,
+      [&]<Accuracy accuracy>() -> std::pair<ScalarType, ScalarType> {
+        return compute_score_and_derivative_impl<accuracy>(depth);
+      });
+}
+
+void RaySceneElements::compute_scores(std::span<const ScalarType> depths,
+                                      std::span<ScalarType> scores,
+                                      std::span<ScalarType> variances) const {
+  UTIL_CHECK(depths.size() == scores.size(), "Attempted to compute ",
+             depths.size(), " scores into ", scores.size(), " outputs");
+  UTIL_CHECK(variances.empty() || variances.size() == depths.size(),
+             "Attempted to compute ", depths.size(), " variances into ",
+             variances.size(), " outputs");
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    compute_scores_impl<accuracy>(depths, scores, variances);
+  });
+}
+
+template <Accuracy accuracy>
+RaySceneElements::ScalarType RaySceneElements::compute_score_impl(
+    ScalarType depth, ScalarType* variance) const {
+  using Form = RayForms<accuracy>;
   ScalarType score = 0;
-  for (const auto& element : elements_) {
-    score += (*element)(position);
+  score += sum_forms<Form::radial>(radials_, depth);
+  for (size_t j = 0; j + 1 < polynomial_offsets_.size(); ++j) {
+    ScalarType value = 0;
+    for (size_t k = polynomial_offsets_[j + 1];
+         k-- > polynomial_offsets_[j];) {
+      value = value * depth + polynomial_coefficients_[k];
+    }
+    score += value;
+  }
+  score += sum_forms<Form::sinusoid>(sinusoids_, depth);
+  score += sum_forms<Form::radial_sinusoid>(radial_sinusoids_, depth);
+  if (band_limited()) {
+    check_band_limited_sorted();
+    const auto sinusoids = sum_band_limited_forms<Form::band_limited_sinusoid>(
+        band_limited_sinusoids_, depth);
+    const auto radial_sinusoids =
+        sum_band_limited_forms<Form::band_limited_radial_sinusoid>(
+            band_limited_radial_sinusoids_, depth);
+    score += sinusoids.value + radial_sinusoids.value;
+    if (variance != nullptr) {
+      *variance = std::max(band_limited_variance() - sinusoids.variance -
+                               radial_sinusoids.variance,
+                           ScalarType{0});
+    }
+  }
+  score += sum_forms<Form::polar_sinusoid>(polar_sinusoids_, depth);
+  score += sum_forms<Form::minus_exp>(minus_exps_, depth);
+  score += sum_forms<WyvillForms::value>(wyvill_metaballs_, depth);
+  score += sum_forms<QuinticForms::value>(quintic_metaballs_, depth);
+  return score;
+}
+
+template <Accuracy accuracy>
+std::pair<RaySceneElements::ScalarType, RaySceneElements::ScalarType>
+RaySceneElements::compute_score_and_derivative_impl(ScalarType depth) const {
+  using Form = RayForms<accuracy>;
+  ScalarType score = 0, derivative = 0;
+  auto add = [&](const ValueAndDerivative& sum) {
+    score += sum.value;
+    derivative += sum.derivative;
+  };
+  add(sum_forms_with_derivative<Form::radial_with_derivative>(radials_,
+                                                              depth));
+  for (size_t j = 0; j + 1 < polynomial_offsets_.size(); ++j) {
+    ScalarType value = 0, value_derivative = 0;
+    for (size_t k = polynomial_offsets_[j + 1];
+         k-- > polynomial_offsets_[j];) {
+      value_derivative = value_derivative * depth + value;
+      value = value * depth + polynomial_coefficients_[k];
+    }
+    add({value, value_derivative});
+  }
+  add(sum_forms_with_derivative<Form::sinusoid_with_derivative>(sinusoids_,
+                                                                depth));
+  add(sum_forms_with_derivative<Form::band_limited_sinusoid_with_derivative>(
+      band_limited_sinusoids_, depth));
+  add(sum_forms_with_derivative<Form::radial_sinusoid_with_derivative>(
+      radial_sinusoids_, depth));
+  add(sum_forms_with_derivative<
+      Form::band_limited_radial_sinusoid_with_derivative>(
+      band_limited_radial_sinusoids_, depth));
+  add(sum_forms_with_derivative<Form::polar_sinusoid_with_derivative>(
+      polar_sinusoids_, depth));
+  add(sum_forms_with_derivative<Form::minus_exp_with_derivative>(minus_exps_,
+                                                                 depth));
+  add(sum_forms_with_derivative<WyvillForms::with_derivative>(
+      wyvill_metaballs_, depth));
+  add(sum_forms_with_derivative<QuinticForms::with_derivative>(
+      quintic_metaballs_, depth));
+  return {score, derivative};
+}
+
+bool RaySceneElements::use_nufft(std::span<const ScalarType> depths) const {
+  if (nufft_tolerance_ <= 0 || sinusoids_.size() == 0 || depths.empty()) {
+    return false;
+  }
+  ScalarType max_frequency = 0;
+  for (const auto& frequency : sinusoids_.params[0]) {
+    max_frequency = std::max(max_frequency, std::abs(frequency));
+  }
+  const auto [depth_min, depth_max] =
+      std::minmax_element(depths.begin(), depths.end());
+  return util::nufft::relative_cost(sinusoids_.size(), depths.size(),
+                                    max_frequency, *depth_max - *depth_min,
+                                    nufft_tolerance_) < 1;
+}
+
+template <Accuracy accuracy>
+void RaySceneElements::compute_scores_impl(
+    std::span<const ScalarType> depths, std::span<ScalarType> scores,
+    std::span<ScalarType> variances) const {
+  using Form = RayForms<accuracy>;
+  std::fill(scores.begin(), scores.end(), 0);
+  std::fill(variances.begin(), variances.end(), 0);
+  add_forms<Form::radial>(radials_, depths, scores);
+  const auto* xs = depths.data();
+  auto* out = scores.data();
+  const size_t size = depths.size();
+  for (size_t j = 0; j + 1 < polynomial_offsets_.size(); ++j) {
+    const auto* coeffs =
+        polynomial_coefficients_.data() + polynomial_offsets_[j];
+    const size_t num_coeffs =
+        polynomial_offsets_[j + 1] - polynomial_offsets_[j];
+#pragma omp simd
+    for (size_t i = 0; i < size; ++i) {
+      ScalarType value = 0;
+      for (size_t k = num_coeffs; k-- > 0;) {
+        value = value * xs[i] + coeffs[k];
+      }
+      out[i] += value;
+    }
   }
-  return apply_density_threshold(score);
-}
+  if (use_nufft(depths)) {
+    const auto& [frequencies, phases, amplitudes] = sinusoids_.params;
+    util::nufft::add_cosine_sum(frequencies, phases, amplitudes, depths,
+                                scores, nufft_tolerance_);
+  } else {
+    add_forms<Form::sinusoid>(sinusoids_, depths, scores);
+  }
+  add_forms<Form::radial_sinusoid>(radial_sinusoids_, depths, scores);
+  add_forms<Form::polar_sinusoid>(polar_sinusoids_, depths, scores);
+  add_forms<Form::minus_exp>(minus_exps_, depths, scores);
 
-Scene::ScalarType Scene::apply_density_threshold(
-    const ScalarType& score) const {
-  if (density_threshold_width_ == 0) {
-    return score >= density_threshold_ ? 1. : 0.;
+  // Band-limited forms and metaballs only need to be evaluated where
+  // they are nonzero, which is found by binary search if depths are
+  // sorted
+  // Note: The variances averaged out are the total variance of the
+  // band-limited forms minus the resolved variances.
+  const bool depths_sorted = std::is_sorted(depths.begin(), depths.end());
+  if (band_limited()) {
+    check_band_limited_sorted();
+    add_band_limited_forms<Form::band_limited_sinusoid>(
+        band_limited_sinusoids_, depths, depths_sorted, scores, variances);
+    add_band_limited_forms<Form::band_limited_radial_sinusoid>(
+        band_limited_radial_sinusoids_, depths, depths_sorted, scores,
+        variances);
+    const auto total_variance = band_limited_variance();
+    for (auto& variance : variances) {
+      variance = std::max(total_variance - variance, ScalarType{0});
+    }
+  }
+  if (wyvill_metaballs_.size() + quintic_metaballs_.size() > 0) {
+    if (depths_sorted) {
+      add_metaball_forms<WyvillForms>(wyvill_metaballs_, depths, scores);
+      add_metaball_forms<QuinticForms>(quintic_metaballs_, depths, scores);
+    } else {
+      add_forms<WyvillForms::value>(wyvill_metaballs_, depths, scores);
+      add_forms<QuinticForms::value>(quintic_metaballs_, depths, scores);
+    }
   }
-  return util::sigmoid((score - density_threshold_) / density_threshold_width_);
 }
 
-Scene::ScalarType Scene::trace_ray(const VectorType& origin,
-                                   const VectorType& orientation,
-                                   const Integrator& integrator) const {
-  // Normalize ray orientation
-  UTIL_CHECK(orientation.norm2() > 0, "Invalid orientation (",
-             static_cast<VectorType::ContainerType>(orientation), ")");
-  const auto orientation_unit = orientation.unit();
+void RaySceneElements::compute_score_bounds(
+    std::span<const ScalarType> depth_edges, std::span<ScalarType> lower,
+    std::span<ScalarType> upper) const {
+  UTIL_CHECK(!depth_edges.empty(), "Depth intervals require edges");
+  UTIL_CHECK(lower.size() == depth_edges.size() - 1,
+             "Depth intervals and lower bounds do not match (",
+             depth_edges.size() - 1, " intervals, ", lower.size(),
+             " lower bounds)");
+  UTIL_CHECK(upper.size() == depth_edges.size() - 1,
+             "Depth intervals and upper bounds do not match (",
+             depth_edges.size() - 1, " intervals, ", upper.size(),
+             " upper bounds)");
 
-  // Decay factor
-  // Note: Define s = x/x0 and apply decay of C*s*exp(-s). The decay
-  // peaks at x=x0, i.e. s=1. With C=1, the integral of the decay over
-  // [0,inf) is 1.
-  const ScalarType x0 = 1;
-  auto decay = [](const ScalarType& s) -> ScalarType {
-    return s * std::exp(-s);
-  };
+  // Note: Bounds do not need to be tight, so they are computed with
+  // low accuracy math functions (see bounds_tolerance).
+  using Form = RayForms<Accuracy::Low>;
 
-  // Integral reparametrization factor
-  // Note: In order to convert integral over [0,inf) to integral over
-  // [0,1], reparametrize s=t/(1-t). This has x=x0 at
-  // t=0.5. This reparametrization requires applying x'(t).
-  auto ds = [](const ScalarType& t) -> ScalarType {
-    const auto tm1 = t - 1;
-    return 1 / (tm1 * tm1);
-  };
+  // Bound oscillating forms by their amplitudes
+  // Note: Tighter bounds are rarely useful, since oscillating forms
+  // usually go through most of their range over a ray segment.
+  const auto oscillation = sum_amplitudes<2>(sinusoids_) +
+                           sum_amplitudes<2>(band_limited_sinusoids_) +
+                           sum_amplitudes<4>(radial_sinusoids_) +
+                           sum_amplitudes<4>(band_limited_radial_sinusoids_) +
+                           sum_amplitudes<7>(polar_sinusoids_);
+  const size_t num_intervals = lower.size();
+  for (size_t start = 0; start < num_intervals;
+       start += max_bounds_batch_size) {
+    const size_t batch_size =
+        std::min(max_bounds_batch_size, num_intervals - start);
+    const auto* x0 = &depth_edges[start];
+    const auto* x1 = &depth_edges[start + 1];
+    std::array<ScalarType, max_bounds_batch_size> batch_lower{},
+        batch_upper{}, lower_magnitude{}, upper_magnitude{};
+    add_form_bounds<Form::radial_bounds>(
+        radials_, batch_size, x0, x1, batch_lower.data(), batch_upper.data(),
+        lower_magnitude.data(), upper_magnitude.data());
 
-  // Function to integrate
-  auto integrand = [&](const ScalarType& t_) -> ScalarType {
-    constexpr ScalarType max =
-        1 - std::numeric_limits<ScalarType>::epsilon() / 2;
-    const auto t = std::min(t_, max);
-    const auto s = t / (1 - t);
-    const auto x = s * x0;
-    return decay(s) * ds(t) * compute_density(origin + x * orientation_unit);
-  };
+    // Interval arithmetic for polynomials
+    // Note: Magnitude is from absolute values of coefficients, which
+    // bounds rounding errors in Horner's method.
+    for (size_t j = 0; j + 1 < polynomial_offsets_.size(); ++j) {
+      for (size_t k = 0; k < batch_size; ++k) {
+        const auto x_max = std::max(std::abs(x0[k]), std::abs(x1[k]));
+        ScalarType poly_lower = 0, poly_upper = 0, poly_magnitude = 0;
+        for (size_t i = polynomial_offsets_[j + 1];
+             i-- > polynomial_offsets_[j];) {
+          const std::array<ScalarType, 4> products = {
+              poly_lower * x0[k], poly_lower * x1[k], poly_upper * x0[k],
+              poly_upper * x1[k]};
+          const auto coeff = polynomial_coefficients_[i];
+          poly_lower =
+              *std::min_element(products.begin(), products.end()) + coeff;
+          poly_upper =
+              *std::max_element(products.begin(), products.end()) + coeff;
+          poly_magnitude = poly_magnitude * x_max + std::abs(coeff);
+        }
+        batch_lower[k] += poly_lower;
+        batch_upper[k] += poly_upper;
+        lower_magnitude[k] += poly_magnitude;
+        upper_magnitude[k] += poly_magnitude;
+      }
+    }
+
+    add_form_bounds<Form::minus_exp_bounds>(
+        minus_exps_, batch_size, x0, x1, batch_lower.data(),
+        batch_upper.data(), lower_magnitude.data(), upper_magnitude.data());
+    add_form_bounds<WyvillForms::bounds>(
+        wyvill_metaballs_, batch_size, x0, x1, batch_lower.data(),
+        batch_upper.data(), lower_magnitude.data(), upper_magnitude.data());
+    add_form_bounds<QuinticForms::bounds>(
+        quintic_metaballs_, batch_size, x0, x1, batch_lower.data(),
+        batch_upper.data(), lower_magnitude.data(), upper_magnitude.data());
 
-  return x0 * integrator(integrand);
+    // Add oscillating forms and widen for approximation errors
+    // Note: Errors are relative to the value of each form, so each
+    // bound only needs a margin relative to its own magnitude.
+    for (size_t k = 0; k < batch_size; ++k) {
+      lower[start + k] =
+          batch_lower[k] - oscillation -
+          bounds_tolerance * (lower_magnitude[k] + oscillation);
+      upper[start + k] =
+          batch_upper[k] + oscillation +
+          bounds_tolerance * (upper_magnitude[k] + oscillation);
+    }
+  }
 }
 
 std::unique_ptr<SceneElement> SceneElement::make_element(
@@ -126,8 +2163,17 @@ std::unique_ptr<SceneElement> SceneElement::make_element(
   const auto& params =
       config_parsed.size() > 1 ? util::strip(config_parsed[1]) : "";
   if (type == "radial") {
-    const auto center = random::randn<VectorType>();
-    return std::make_unique<RadialSceneElement>(center, 2.);
+    constexpr ScalarType decay = 2.;
+    if (params.empty()) {
+      const auto center = random::randn<VectorType>();
+      return std::make_unique<RadialSceneElement>(center, decay);
+    }
+    const auto num_components = util::from_string<size_t>(params);
+    std::vector<MultiRadialSceneElement::Component> components;
+    for (size_t i = 0; i < num_components; ++i) {
+      components.push_back({random::randn<VectorType>(), decay * decay});
+    }
+    return std::make_unique<MultiRadialSceneElement>(std::move(components));
   }
   if (type == "polynomial") {
     const size_t degree =
@@ -240,15 +2286,65 @@ std::unique_ptr<SceneElement> SceneElement::make_element(
     }
     return result;
   }
+  if (type == "metaball") {
+    const auto& params_split = util::split(params, ",");
+    const size_t num_metaballs =
+        params.empty() ? 1 : util::from_string<size_t>(params_split[0]);
+    const ScalarType radius =
+        params_split.size() < 2
+            ? 1.0
+            : util::from_string<ScalarType>(params_split[1]);
+    auto falloff = MetaballFalloff::Wyvill;
+    if (params_split.size() >= 3) {
+      const auto& falloff_name = util::strip(params_split[2]);
+      if (falloff_name == "quintic") {
+        falloff = MetaballFalloff::Quintic;
+      } else {
+        UTIL_CHECK(falloff_name == "wyvill", "Unrecognized metaball falloff (",
+                   falloff_name, "), expected wyvill or quintic");
+      }
+    }
+    std::vector<MetaballSceneElement::Metaball> metaballs;
+    for (size_t i = 0; i < num_metaballs; ++i) {
+      metaballs.push_back({random::randn<VectorType>(), radius, falloff});
+    }
+    return std::make_unique<MetaballSceneElement>(metaballs);
+  }
   UTIL_ERROR("Unrecognized scene element (", type, ")");
 }
 
+bool SceneElement::is_zero() const { return false; }
+
+std::vector<std::string> SceneElement::source_terms() const {
+  UTIL_ERROR("Scene element does not support JIT compilation (", describe(),
+             ")");
+}
+
+void SceneElement::restrict_to_ray(const VectorType&, const VectorType&,
+                                   RaySceneElements&) const {
+  UTIL_ERROR("Scene element can not be restricted to ray (", describe(), ")");
+}
+
+SceneElement::Accuracy SceneElement::accuracy() const { return accuracy_; }
+
+void SceneElement::set_accuracy(Accuracy accuracy) { accuracy_ = accuracy; }
+
 MultiSceneElement::MultiSceneElement() {}
 
 void MultiSceneElement::add_element(std::unique_ptr<SceneElement>&& element) {
+  UTIL_CHECK(element != nullptr, "Attempted to add null scene element");
+  element->set_accuracy(accuracy_);
   elements_.emplace_back(std::move(element));
 }
 
+const SceneElement& MultiSceneElement::get_element(size_t idx) const {
+  UTIL_CHECK(idx < elements_.size(), "Attempted to access scene element ", idx,
+             ", but there are only ", elements_.size());
+  return *elements_[idx];
+}
+
+size_t MultiSceneElement::num_elements() const { return elements_.size(); }
+
 MultiSceneElement::ScalarType MultiSceneElement::operator()(
     const VectorType& position) const {
   ScalarType score = 0;
@@ -258,6 +2354,19 @@ MultiSceneElement::ScalarType MultiSceneElement::operator()(
   return score;
 }
 
+void MultiSceneElement::evaluate(std::span<const VectorType> positions,
+                                 std::span<ScalarType> out,
+                                 bool accumulate) const {
+  if (elements_.empty()) {
+    evaluate_positions(positions, out, accumulate,
+                       [](const VectorType&) -> ScalarType { return 0; });
+    return;
+  }
+  for (size_t i = 0; i < elements_.size(); ++i) {
+    elements_[i]->evaluate(positions, out, accumulate || i > 0);
+  }
+}
+
 std::string MultiSceneElement::describe() const {
   std::string desc = "MultiSceneElement (";
   for (size_t i = 0; i < elements_.size(); ++i) {
@@ -270,6 +2379,35 @@ std::string MultiSceneElement::describe() const {
   return desc;
 }
 
+bool MultiSceneElement::is_zero() const {
+  return std::all_of(elements_.begin(), elements_.end(),
+                     [](const auto& element) { return element->is_zero(); });
+}
+
+std::vector<std::string> MultiSceneElement::source_terms() const {
+  std::vector<std::string> terms;
+  for (const auto& element : elements_) {
+    const auto element_terms = element->source_terms();
+    terms.insert(terms.end(), element_terms.begin(), element_terms.end());
+  }
+  return terms;
+}
+
+void MultiSceneElement::restrict_to_ray(const VectorType& origin,
+                                        const VectorType& direction,
+                                        RaySceneElements& ray) const {
+  for (const auto& element : elements_) {
+    element->restrict_to_ray(origin, direction, ray);
+  }
+}
+
+void MultiSceneElement::set_accuracy(Accuracy accuracy) {
+  accuracy_ = accuracy;
+  for (auto& element : elements_) {
+    element->set_accuracy(accuracy);
+  }
+}
+
 RadialSceneElement::RadialSceneElement(const VectorType& center,
                                        const ScalarType& decay)
     : center_{center}, decay_square_{decay * decay} {}
@@ -279,10 +2417,226 @@ RadialSceneElement::ScalarType RadialSceneElement::operator()(
   return 1 / (1 + decay_square_ * (position - center_).norm2());
 }
 
+void RadialSceneElement::evaluate(std::span<const VectorType> positions,
+                                  std::span<ScalarType> out,
+                                  bool accumulate) const {
+  evaluate_positions(positions, out, accumulate,
+                     [this](const VectorType& position) -> ScalarType {
+                       return RadialSceneElement::operator()(position);
+                     });
+}
+
 std::string RadialSceneElement::describe() const {
   return util::concat_strings("RadialSceneElement (center=", center_, ")");
 }
 
+std::vector<std::string> RadialSceneElement::source_terms() const {
+  return {util::concat_strings("(1 / (1 + ", jit::literal(decay_square_), " * ",
+                              source_norm2(source_offset(center_)), "))")};
+}
+
+void RadialSceneElement::restrict_to_ray(const VectorType& origin,
+                                         const VectorType& direction,
+                                         RaySceneElements& ray) const {
+  const auto [shift, perp2] = ray_distance(origin, direction, center_);
+  ray.add_radial(shift, perp2, decay_square_);
+}
+
+const RadialSceneElement::VectorType& RadialSceneElement::center() const {
+  return center_;
+}
+
+RadialSceneElement::ScalarType RadialSceneElement::decay_square() const {
+  return decay_square_;
+}
+
+MultiRadialSceneElement::MultiRadialSceneElement(
+    std::vector<Component> components, ScalarType far_field_theta)
+    : components_{std::move(components)}, far_field_theta_{far_field_theta} {
+  UTIL_CHECK(far_field_theta_ >= 0, "Invalid far-field theta (",
+             far_field_theta_, ")");
+  UTIL_CHECK(components_.size() < std::numeric_limits<uint32_t>::max(),
+             "Too many radial components (", components_.size(), ")");
+
+  // Build tree for each decay
+  std::stable_sort(components_.begin(), components_.end(),
+                   [](const Component& a, const Component& b) -> bool {
+                     return a.decay_square < b.decay_square;
+                   });
+  for (size_t begin = 0; begin < components_.size();) {
+    size_t end = begin + 1;
+    while (end < components_.size() &&
+           components_[end].decay_square == components_[begin].decay_square) {
+      ++end;
+    }
+    roots_.push_back(build_tree(begin, end));
+    begin = end;
+  }
+}
+
+uint32_t MultiRadialSceneElement::build_tree(size_t begin, size_t end) {
+  // Centroid and bounding box of components
+  VectorType centroid, lower, upper;
+  lower.fill(std::numeric_limits<ScalarType>::infinity());
+  upper.fill(-std::numeric_limits<ScalarType>::infinity());
+  for (size_t i = begin; i < end; ++i) {
+    const auto& center = components_[i].center;
+    centroid += center;
+    for (size_t d = 0; d < ndim; ++d) {
+      lower[d] = std::min(lower[d], center[d]);
+      upper[d] = std::max(upper[d], center[d]);
+    }
+  }
+  centroid *= ScalarType{1} / (end - begin);
+  ScalarType radius_square = 0;
+  for (size_t i = begin; i < end; ++i) {
+    radius_square =
+        std::max(radius_square, (components_[i].center - centroid).norm2());
+  }
+  const auto idx = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back({centroid, radius_square, components_[begin].decay_square,
+                    static_cast<uint32_t>(begin), static_cast<uint32_t>(end),
+                    0});
+
+  // Split at median of widest dimension
+  if (end - begin > leaf_size) {
+    size_t split_dim = 0;
+    for (size_t d = 1; d < ndim; ++d) {
+      if (upper[d] - lower[d] > upper[split_dim] - lower[split_dim]) {
+        split_dim = d;
+      }
+    }
+    const size_t middle = begin + (end - begin) / 2;
+    std::nth_element(components_.begin() + begin, components_.begin() + middle,
+                     components_.begin() + end,
+                     [split_dim](const Component& a, const Component& b) {
+                       return a.center[split_dim] < b.center[split_dim];
+                     });
+    build_tree(begin, middle);
+    nodes_[idx].right = build_tree(middle, end);
+  }
+  return idx;
+}
+
+template <typename Accept, typename Leaf>
+void MultiRadialSceneElement::visit_tree(Accept&& accept, Leaf&& leaf) const {
+  if (far_field_theta_ == 0) {
+    leaf(0, components_.size());
+    return;
+  }
+
+  // Depth-first traversal
+  // Note: Trees are split at the median, so the stack of right
+  // children is shorter than 64.
+  std::array<uint32_t, 64> stack;
+  for (const auto& root : roots_) {
+    size_t stack_size = 0;
+    uint32_t idx = root;
+    while (true) {
+      const auto& node = nodes_[idx];
+      if (!accept(node)) {
+        if (node.right != 0) {
+          stack[stack_size++] = node.right;
+          ++idx;
+          continue;
+        }
+        leaf(node.begin, node.end);
+      }
+      if (stack_size == 0) {
+        break;
+      }
+      idx = stack[--stack_size];
+    }
+  }
+}
+
+MultiRadialSceneElement::ScalarType MultiRadialSceneElement::operator()(
+    const VectorType& position) const {
+  const auto theta_square = far_field_theta_ * far_field_theta_;
+  ScalarType result = 0;
+  visit_tree(
+      [&](const Node& node) -> bool {
+        const auto dist2 = (position - node.centroid).norm2();
+        if (node.radius_square < theta_square * dist2) {
+          result += (node.end - node.begin) / (1 + node.decay_square * dist2);
+          return true;
+        }
+        return false;
+      },
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const auto& component = components_[i];
+          const auto dist2 = (position - component.center).norm2();
+          result += 1 / (1 + component.decay_square * dist2);
+        }
+      });
+  return result;
+}
+
+void MultiRadialSceneElement::evaluate(std::span<const VectorType> positions,
+                                       std::span<ScalarType> out,
+                                       bool accumulate) const {
+  evaluate_positions(positions, out, accumulate,
+                     [this](const VectorType& position) -> ScalarType {
+                       return MultiRadialSceneElement::operator()(position);
+                     });
+}
+
+std::string MultiRadialSceneElement::describe() const {
+  return util::concat_strings(
+      "MultiRadialSceneElement (num_components=", components_.size(),
+      ", far_field_theta=", far_field_theta_, ")");
+}
+
+bool MultiRadialSceneElement::is_zero() const { return components_.empty(); }
+
+std::vector<std::string> MultiRadialSceneElement::source_terms() const {
+  std::vector<std::string> terms;
+  for (const auto& component : components_) {
+    terms.push_back(util::concat_strings(
+        "(1 / (1 + ", jit::literal(component.decay_square), " * ",
+        source_norm2(source_offset(component.center)), "))"));
+  }
+  return terms;
+}
+
+void MultiRadialSceneElement::restrict_to_ray(const VectorType& origin,
+                                              const VectorType& direction,
+                                              RaySceneElements& ray) const {
+  const auto theta_square = far_field_theta_ * far_field_theta_;
+  visit_tree(
+      [&](const Node& node) -> bool {
+        // Distance from centroid to nearest point at nonnegative depth
+        const auto [shift, perp2] =
+            ray_distance(origin, direction, node.centroid);
+        const auto dist2 = shift > 0 ? shift * shift + perp2 : perp2;
+        if (node.radius_square < theta_square * dist2) {
+          ray.add_radial(shift, perp2, node.decay_square,
+                         node.end - node.begin);
+          return true;
+        }
+        return false;
+      },
+      [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const auto& component = components_[i];
+          const auto [shift, perp2] =
+              ray_distance(origin, direction, component.center);
+          ray.add_radial(shift, perp2, component.decay_square);
+        }
+      });
+}
+
+const std::vector<MultiRadialSceneElement::Component>&
+MultiRadialSceneElement::components() const {
+  return components_;
+}
+
+MultiRadialSceneElement::ScalarType MultiRadialSceneElement::far_field_theta()
+    const {
+  return far_field_theta_;
+}
+
 PolynomialSceneElement::PolynomialSceneElement(
     std::vector<VectorType> coefficients, const VectorType& center)
     : coefficients_{std::move(coefficients)}, center_{center} {}
@@ -297,11 +2651,55 @@ PolynomialSceneElement::ScalarType PolynomialSceneElement::operator()(
   return result;
 }
 
+void PolynomialSceneElement::evaluate(std::span<const VectorType> positions,
+                                      std::span<ScalarType> out,
+                                      bool accumulate) const {
+  evaluate_positions(positions, out, accumulate,
+                     [this](const VectorType& position) -> ScalarType {
+                       return PolynomialSceneElement::operator()(position);
+                     });
+}
+
 std::string PolynomialSceneElement::describe() const {
   return util::concat_strings("PolynomialSceneElement (coefficients=",
                               coefficients_, ", center=", center_, ")");
 }
 
+bool PolynomialSceneElement::is_zero() const {
+  return std::any_of(
+      coefficients_.begin(), coefficients_.end(),
+      [](const VectorType& coeffs) { return coeffs.norm2() == 0; });
+}
+
+std::vector<std::string> PolynomialSceneElement::source_terms() const {
+  const auto offset = source_offset(center_);
+  std::string result = "(1";
+  for (const auto& coeffs : coefficients_) {
+    result += " * " + source_dot(offset, coeffs);
+  }
+  result += ")";
+  return {result};
+}
+
+void PolynomialSceneElement::restrict_to_ray(const VectorType& origin,
+                                             const VectorType& direction,
+                                             RaySceneElements& ray) const {
+  // Expand product of linear factors into polynomial in depth
+  const auto offset = origin - center_;
+  std::vector<ScalarType> poly = {1};
+  poly.reserve(coefficients_.size() + 1);
+  for (const auto& coeffs : coefficients_) {
+    const auto slope = util::dot(coeffs, direction);
+    const auto intercept = util::dot(coeffs, offset);
+    poly.push_back(0);
+    for (size_t k = poly.size() - 1; k > 0; --k) {
+      poly[k] = poly[k] * intercept + poly[k - 1] * slope;
+    }
+    poly[0] *= intercept;
+  }
+  ray.add_polynomial(poly);
+}
+
 SinusoidSceneElement::SinusoidSceneElement(const VectorType& wave_vector,
                                            const ScalarType& phase,
                                            const ScalarType& amplitude)
@@ -309,10 +2707,28 @@ SinusoidSceneElement::SinusoidSceneElement(const VectorType& wave_vector,
 
 SinusoidSceneElement::ScalarType SinusoidSceneElement::operator()(
     const VectorType& position) const {
-  constexpr ScalarType two_pi = 2 * std::numbers::pi;
-  ScalarType result = amplitude_;
-  result *= std::cos(two_pi * (util::dot(position, wave_vector_) + phase_));
-  return result;
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return evaluate_one<accuracy>(position);
+      });
+}
+
+void SinusoidSceneElement::evaluate(std::span<const VectorType> positions,
+                                    std::span<ScalarType> out,
+                                    bool accumulate) const {
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    evaluate_positions(positions, out, accumulate,
+                       [this](const VectorType& position) -> ScalarType {
+                         return evaluate_one<accuracy>(position);
+                       });
+  });
+}
+
+template <Accuracy accuracy>
+SinusoidSceneElement::ScalarType SinusoidSceneElement::evaluate_one(
+    const VectorType& position) const {
+  const auto cycles = util::dot(position, wave_vector_) + phase_;
+  return amplitude_ * util::simd_math::cos_cycles<accuracy>(cycles);
 }
 
 std::string SinusoidSceneElement::describe() const {
@@ -321,24 +2737,179 @@ std::string SinusoidSceneElement::describe() const {
       ", amplitude=", amplitude_, ")");
 }
 
+bool SinusoidSceneElement::is_zero() const { return amplitude_ == 0; }
+
+std::vector<std::string> SinusoidSceneElement::source_terms() const {
+  const std::array<std::string, ndim> position = {"x0", "x1", "x2", "x3"};
+  return {util::concat_strings(
+      "(", jit::literal(amplitude_),
+      " * util::simd_math::cos_cycles<accuracy>(",
+      source_dot(position, wave_vector_), " + ", jit::literal(phase_), "))")};
+}
+
+void SinusoidSceneElement::restrict_to_ray(const VectorType& origin,
+                                           const VectorType& direction,
+                                           RaySceneElements& ray) const {
+  const auto frequency = util::dot(wave_vector_, direction);
+  const auto phase = util::dot(wave_vector_, origin) + phase_;
+  if (ray.footprint() > 0) {
+    ray.add_band_limited_sinusoid(frequency, phase, amplitude_,
+                                  ray.band_limit_rate(wave_vector_.norm2()));
+    return;
+  }
+  ray.add_sinusoid(frequency, phase, amplitude_);
+}
+
+const SinusoidSceneElement::VectorType& SinusoidSceneElement::wave_vector()
+    const {
+  return wave_vector_;
+}
+
+SinusoidSceneElement::ScalarType SinusoidSceneElement::phase() const {
+  return phase_;
+}
+
+SinusoidSceneElement::ScalarType SinusoidSceneElement::amplitude() const {
+  return amplitude_;
+}
+
 MultiSinusoidSceneElement::MultiSinusoidSceneElement(
-    std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components)
-    : components_{std::move(components)} {}
+    const std::vector<std::tuple<VectorType, ScalarType, ScalarType>>&
+        components) {
+  for (auto& wave_vector_components : wave_vectors_) {
+    wave_vector_components.reserve(components.size());
+  }
+  phases_.reserve(components.size());
+  amplitudes_.reserve(components.size());
+  for (const auto& [wave_vector, phase, amplitude] : components) {
+    for (size_t d = 0; d < ndim; ++d) {
+      wave_vectors_[d].push_back(wave_vector[d]);
+    }
+    phases_.push_back(phase);
+    amplitudes_.push_back(amplitude);
+  }
+}
 
 MultiSinusoidSceneElement::ScalarType MultiSinusoidSceneElement::operator()(
     const VectorType& position) const {
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return evaluate_one<accuracy>(position);
+      });
+}
+
+void MultiSinusoidSceneElement::evaluate(std::span<const VectorType> positions,
+                                         std::span<ScalarType> out,
+                                         bool accumulate) const {
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    evaluate_positions(positions, out, accumulate,
+                       [this](const VectorType& position) -> ScalarType {
+                         return evaluate_one<accuracy>(position);
+                       });
+  });
+}
+
+template <Accuracy accuracy>
+MultiSinusoidSceneElement::ScalarType MultiSinusoidSceneElement::evaluate_one(
+    const VectorType& position) const {
+  static_assert(ndim == 4, "SIMD kernel assumes 4D positions");
+  const ScalarType x0 = position[0], x1 = position[1], x2 = position[2],
+                   x3 = position[3];
+  const auto* k0 = wave_vectors_[0].data();
+  const auto* k1 = wave_vectors_[1].data();
+  const auto* k2 = wave_vectors_[2].data();
+  const auto* k3 = wave_vectors_[3].data();
+  const auto* phases = phases_.data();
+  const auto* amplitudes = amplitudes_.data();
+  const size_t num_components = phases_.size();
   ScalarType result = 0;
-  constexpr ScalarType two_pi = 2 * std::numbers::pi;
-  for (const auto& [wave_vector, phase, amplitude] : components_) {
-    result += amplitude *
-              std::cos(two_pi * (util::dot(position, wave_vector) + phase));
+#pragma omp simd reduction(+ : result)
+  for (size_t j = 0; j < num_components; ++j) {
+    const auto cycles =
+        phases[j] + x0 * k0[j] + x1 * k1[j] + x2 * k2[j] + x3 * k3[j];
+    result += amplitudes[j] * util::simd_math::cos_cycles<accuracy>(cycles);
   }
   return result;
 }
 
 std::string MultiSinusoidSceneElement::describe() const {
   return util::concat_strings(
-      "MultiSinusoidSceneElement (components=", components_, ")");
+      "MultiSinusoidSceneElement (components=", components(), ")");
+}
+
+bool MultiSinusoidSceneElement::is_zero() const {
+  return std::all_of(
+      amplitudes_.begin(), amplitudes_.end(),
+      [](const ScalarType& amplitude) { return amplitude == 0; });
+}
+
+std::vector<std::string> MultiSinusoidSceneElement::source_terms() const {
+  std::vector<std::string> terms;
+  for (size_t j = 0; j < phases_.size(); ++j) {
+    std::string cycles = jit::literal(phases_[j]);
+    for (size_t d = 0; d < ndim; ++d) {
+      cycles += util::concat_strings(" + x", d, " * ",
+                                     jit::literal(wave_vectors_[d][j]));
+    }
+    terms.push_back(util::concat_strings(
+        jit::literal(amplitudes_[j]),
+        " * util::simd_math::cos_cycles<accuracy>(", cycles, ")"));
+  }
+  return terms;
+}
+
+void MultiSinusoidSceneElement::restrict_to_ray(const VectorType& origin,
+                                                const VectorType& direction,
+                                                RaySceneElements& ray) const {
+  static_assert(ndim == 4, "SIMD kernel assumes 4D positions");
+  const ScalarType x0 = origin[0], x1 = origin[1], x2 = origin[2],
+                   x3 = origin[3];
+  const ScalarType d0 = direction[0], d1 = direction[1], d2 = direction[2],
+                   d3 = direction[3];
+  const auto* k0 = wave_vectors_[0].data();
+  const auto* k1 = wave_vectors_[1].data();
+  const auto* k2 = wave_vectors_[2].data();
+  const auto* k3 = wave_vectors_[3].data();
+  const size_t num_components = phases_.size();
+  if (ray.footprint() > 0) {
+    // Note: Band-limiting rate is proportional to squared wavenumber.
+    const auto rate_scale = ray.band_limit_rate(1);
+    const auto [frequencies, phases, amplitudes, rates] =
+        ray.add_band_limited_sinusoids(num_components);
+#pragma omp simd
+    for (size_t j = 0; j < num_components; ++j) {
+      frequencies[j] = d0 * k0[j] + d1 * k1[j] + d2 * k2[j] + d3 * k3[j];
+      phases[j] =
+          phases_[j] + x0 * k0[j] + x1 * k1[j] + x2 * k2[j] + x3 * k3[j];
+      rates[j] = rate_scale * (k0[j] * k0[j] + k1[j] * k1[j] +
+                               k2[j] * k2[j] + k3[j] * k3[j]);
+    }
+    std::copy(amplitudes_.begin(), amplitudes_.end(), amplitudes.begin());
+    return;
+  }
+  const auto [frequencies, phases, amplitudes] =
+      ray.add_sinusoids(num_components);
+#pragma omp simd
+  for (size_t j = 0; j < num_components; ++j) {
+    frequencies[j] = d0 * k0[j] + d1 * k1[j] + d2 * k2[j] + d3 * k3[j];
+    phases[j] = phases_[j] + x0 * k0[j] + x1 * k1[j] + x2 * k2[j] + x3 * k3[j];
+  }
+  std::copy(amplitudes_.begin(), amplitudes_.end(), amplitudes.begin());
+}
+
+std::vector<std::tuple<MultiSinusoidSceneElement::VectorType,
+                       MultiSinusoidSceneElement::ScalarType,
+                       MultiSinusoidSceneElement::ScalarType>>
+MultiSinusoidSceneElement::components() const {
+  std::vector<std::tuple<VectorType, ScalarType, ScalarType>> components;
+  for (size_t j = 0; j < phases_.size(); ++j) {
+    VectorType wave_vector;
+    for (size_t d = 0; d < ndim; ++d) {
+      wave_vector[d] = wave_vectors_[d][j];
+    }
+    components.emplace_back(wave_vector, phases_[j], amplitudes_[j]);
+  }
+  return components;
 }
 
 std::unique_ptr<MultiSinusoidSceneElement>
@@ -413,13 +2984,34 @@ RadialSinusoidSceneElement::RadialSinusoidSceneElement(
     : center_{center},
       frequency_{frequency},
       phase_{phase},
-      amplitude_{amplitude} {}
+      amplitude_{amplitude},
+      phase_cycles_{phase / (2 * std::numbers::pi)} {}
 
 RadialSinusoidSceneElement::ScalarType RadialSinusoidSceneElement::operator()(
     const VectorType& position) const {
-  constexpr ScalarType two_pi = 2 * std::numbers::pi;
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return evaluate_one<accuracy>(position);
+      });
+}
+
+void RadialSinusoidSceneElement::evaluate(std::span<const VectorType> positions,
+                                          std::span<ScalarType> out,
+                                          bool accumulate) const {
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    evaluate_positions(positions, out, accumulate,
+                       [this](const VectorType& position) -> ScalarType {
+                         return evaluate_one<accuracy>(position);
+                       });
+  });
+}
+
+template <Accuracy accuracy>
+RadialSinusoidSceneElement::ScalarType RadialSinusoidSceneElement::evaluate_one(
+    const VectorType& position) const {
   const auto& r = (position - center_).norm();
-  return amplitude_ * std::cos(two_pi * frequency_ * r + phase_);
+  return amplitude_ *
+         util::simd_math::cos_cycles<accuracy>(frequency_ * r + phase_cycles_);
 }
 
 std::string RadialSinusoidSceneElement::describe() const {
@@ -428,6 +3020,31 @@ std::string RadialSinusoidSceneElement::describe() const {
                               ", amplitude=", amplitude_, ")");
 }
 
+bool RadialSinusoidSceneElement::is_zero() const { return amplitude_ == 0; }
+
+std::vector<std::string> RadialSinusoidSceneElement::source_terms() const {
+  return {util::concat_strings(
+      "(", jit::literal(amplitude_),
+      " * util::simd_math::cos_cycles<accuracy>(",
+      jit::literal(frequency_), " * std::sqrt(",
+      source_norm2(source_offset(center_)), ") + ", jit::literal(phase_cycles_),
+      "))")};
+}
+
+void RadialSinusoidSceneElement::restrict_to_ray(const VectorType& origin,
+                                                 const VectorType& direction,
+                                                 RaySceneElements& ray) const {
+  const auto [shift, perp2] = ray_distance(origin, direction, center_);
+  if (ray.footprint() > 0) {
+    ray.add_band_limited_radial_sinusoid(
+        shift, perp2, frequency_, phase_cycles_, amplitude_,
+        ray.band_limit_rate(frequency_ * frequency_));
+    return;
+  }
+  ray.add_radial_sinusoid(shift, perp2, frequency_, phase_cycles_,
+                          amplitude_);
+}
+
 PolarSinusoidSceneElement::PolarSinusoidSceneElement(
     const VectorType& center, const VectorType& orientation,
     const ScalarType& radial_frequency, const ScalarType& polar_frequency,
@@ -437,19 +3054,40 @@ PolarSinusoidSceneElement::PolarSinusoidSceneElement(
       radial_frequency_{radial_frequency},
       polar_frequency_{polar_frequency},
       phase_{phase},
-      amplitude_{amplitude} {}
+      amplitude_{amplitude},
+      phase_cycles_{phase / (2 * std::numbers::pi)} {}
 
 PolarSinusoidSceneElement::ScalarType PolarSinusoidSceneElement::operator()(
     const VectorType& position) const {
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return evaluate_one<accuracy>(position);
+      });
+}
+
+void PolarSinusoidSceneElement::evaluate(std::span<const VectorType> positions,
+                                         std::span<ScalarType> out,
+                                         bool accumulate) const {
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    evaluate_positions(positions, out, accumulate,
+                       [this](const VectorType& position) -> ScalarType {
+                         return evaluate_one<accuracy>(position);
+                       });
+  });
+}
+
+template <Accuracy accuracy>
+PolarSinusoidSceneElement::ScalarType PolarSinusoidSceneElement::evaluate_one(
+    const VectorType& position) const {
   constexpr ScalarType one = 1;
-  constexpr ScalarType two_pi = 2 * std::numbers::pi;
   const auto& pos = position - center_;
   const auto& r = pos.norm();
   const auto& cos_theta = util::dot(pos / r, orientation_);
-  const auto& theta = std::acos(std::clamp(cos_theta, -one, one));
-  return amplitude_ *
-         std::cos(two_pi * (radial_frequency_ * r + polar_frequency_ * theta) +
-                  phase_);
+  const auto& theta =
+      util::simd_math::acos<accuracy>(std::clamp(cos_theta, -one, one));
+  return amplitude_ * util::simd_math::cos_cycles<accuracy>(
+                          radial_frequency_ * r + polar_frequency_ * theta +
+                          phase_cycles_);
 }
 
 std::string PolarSinusoidSceneElement::describe() const {
@@ -460,13 +3098,67 @@ std::string PolarSinusoidSceneElement::describe() const {
       ", amplitude=", amplitude_, ")");
 }
 
+bool PolarSinusoidSceneElement::is_zero() const { return amplitude_ == 0; }
+
+std::vector<std::string> PolarSinusoidSceneElement::source_terms() const {
+  const auto offset = source_offset(center_);
+  std::array<std::string, ndim> direction;
+  for (size_t d = 0; d < ndim; ++d) {
+    direction[d] = offset[d] + " / r";
+  }
+  return {util::concat_strings(
+      "[=] {\n",
+      "        const double r = std::sqrt(", source_norm2(offset), ");\n",
+      "        const double cos_theta = ", source_dot(direction, orientation_),
+      ";\n",
+      "        const double theta = util::simd_math::acos<accuracy>(",
+      "std::clamp(cos_theta, -1., 1.));\n",
+      "        return ", jit::literal(amplitude_),
+      " * util::simd_math::cos_cycles<accuracy>(",
+      jit::literal(radial_frequency_), " * r + ",
+      jit::literal(polar_frequency_), " * theta + ",
+      jit::literal(phase_cycles_), ");\n",
+      "      }()")};
+}
+
+void PolarSinusoidSceneElement::restrict_to_ray(const VectorType& origin,
+                                                const VectorType& direction,
+                                                RaySceneElements& ray) const {
+  const auto [shift, perp2] = ray_distance(origin, direction, center_);
+  ray.add_polar_sinusoid(shift, perp2, util::dot(direction, orientation_),
+                         util::dot(origin - center_, orientation_),
+                         radial_frequency_, polar_frequency_, phase_cycles_,
+                         amplitude_);
+}
+
 MinusExpSceneElement::MinusExpSceneElement(const VectorType& center,
                                            const ScalarType& dist_scale)
     : center_{center}, dist_scale_square_{dist_scale * dist_scale} {}
 
 MinusExpSceneElement::ScalarType MinusExpSceneElement::operator()(
     const VectorType& position) const {
-  return -std::expm1(dist_scale_square_ * (position - center_).norm2());
+  return util::simd_math::dispatch(
+      accuracy_, [&]<Accuracy accuracy>() -> ScalarType {
+        return evaluate_one<accuracy>(position);
+      });
+}
+
+void MinusExpSceneElement::evaluate(std::span<const VectorType> positions,
+                                    std::span<ScalarType> out,
+                                    bool accumulate) const {
+  util::simd_math::dispatch(accuracy_, [&]<Accuracy accuracy>() {
+    evaluate_positions(positions, out, accumulate,
+                       [this](const VectorType& position) -> ScalarType {
+                         return evaluate_one<accuracy>(position);
+                       });
+  });
+}
+
+template <Accuracy accuracy>
+MinusExpSceneElement::ScalarType MinusExpSceneElement::evaluate_one(
+    const VectorType& position) const {
+  return -util::simd_math::expm1<accuracy>(dist_scale_square_ *
+                                           (position - center_).norm2());
 }
 
 std::string MinusExpSceneElement::describe() const {
@@ -474,4 +3166,194 @@ std::string MinusExpSceneElement::describe() const {
                               ", dist_scale_square=", dist_scale_square_, ")");
 }
 
+bool MinusExpSceneElement::is_zero() const { return dist_scale_square_ == 0; }
+
+std::vector<std::string> MinusExpSceneElement::source_terms() const {
+  return {util::concat_strings("(-util::simd_math::expm1<accuracy>(",
+                              jit::literal(dist_scale_square_), " * ",
+                              source_norm2(source_offset(center_)), "))")};
+}
+
+void MinusExpSceneElement::restrict_to_ray(const VectorType& origin,
+                                           const VectorType& direction,
+                                           RaySceneElements& ray) const {
+  const auto [shift, perp2] = ray_distance(origin, direction, center_);
+  ray.add_minus_exp(shift, perp2, dist_scale_square_);
+}
+
+MetaballSceneElement::MetaballSceneElement(
+    const std::vector<Metaball>& metaballs) {
+  append(metaballs);
+}
+
+MetaballSceneElement::ScalarType MetaballSceneElement::operator()(
+    const VectorType& position) const {
+  if (metaballs_.empty()) {
+    return 0;
+  }
+  ScalarType result = 0;
+  for (const auto& idx : grid_.items(grid_.cell_index(position))) {
+    const auto& metaball = metaballs_[idx];
+    const auto q = (position - metaball.center).norm2() /
+                   (metaball.radius * metaball.radius);
+    result += metaball_kernel(q, metaball.falloff);
+  }
+  return result;
+}
+
+void MetaballSceneElement::evaluate(std::span<const VectorType> positions,
+                                    std::span<ScalarType> out,
+                                    bool accumulate) const {
+  evaluate_positions(positions, out, accumulate,
+                     [this](const VectorType& position) -> ScalarType {
+                       return MetaballSceneElement::operator()(position);
+                     });
+}
+
+std::string MetaballSceneElement::describe() const {
+  return util::concat_strings("MetaballSceneElement (num_metaballs=",
+                              metaballs_.size(), ")");
+}
+
+bool MetaballSceneElement::is_zero() const { return metaballs_.empty(); }
+
+void MetaballSceneElement::restrict_to_ray(const VectorType& origin,
+                                           const VectorType& direction,
+                                           RaySceneElements& ray) const {
+  if (metaballs_.empty()) {
+    return;
+  }
+
+  // Clip ray to bounding box of metaballs
+  ScalarType x_min = -std::numeric_limits<ScalarType>::infinity();
+  ScalarType x_max = std::numeric_limits<ScalarType>::infinity();
+  for (size_t d = 0; d < ndim; ++d) {
+    if (direction[d] == 0) {
+      if (origin[d] < lower_[d] || origin[d] > upper_[d]) {
+        return;
+      }
+      continue;
+    }
+    const auto x0 = (lower_[d] - origin[d]) / direction[d];
+    const auto x1 = (upper_[d] - origin[d]) / direction[d];
+    x_min = std::max(x_min, std::min(x0, x1));
+    x_max = std::min(x_max, std::max(x0, x1));
+  }
+  x_min = std::max(x_min, ScalarType{0});
+  if (!(x_min <= x_max)) {
+    return;
+  }
+
+  // Metaballs that intersect ray at nonnegative depth, from grid
+  // cells crossed by ray
+  // Note: Metaballs are culled before removing duplicates, since each
+  // may be found in several cells and most do not intersect the ray.
+  // A metaball is behind the origin if its center is and the origin
+  // is outside it.
+  auto& hits = ray_buffers().metaballs;
+  hits.clear();
+  grid_.visit_segment(
+      origin, direction, x_min, x_max,
+      [this, &origin, &direction, &hits](std::span<const uint32_t> items) {
+        for (const auto& idx : items) {
+          const auto& metaball = metaballs_[idx];
+          const auto [shift, perp2] =
+              ray_distance(origin, direction, metaball.center);
+          const auto radius_square = metaball.radius * metaball.radius;
+          const bool behind =
+              shift > 0 && shift * shift + perp2 >= radius_square;
+          if (perp2 < radius_square && !behind) {
+            hits.push_back(idx);
+          }
+        }
+      });
+  std::sort(hits.begin(), hits.end());
+  hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+  for (const auto& idx : hits) {
+    const auto& metaball = metaballs_[idx];
+    const auto [shift, perp2] =
+        ray_distance(origin, direction, metaball.center);
+    const auto radius_square = metaball.radius * metaball.radius;
+    ray.add_metaball(shift, perp2, 1 / radius_square, metaball.falloff);
+  }
+}
+
+const std::vector<MetaballSceneElement::Metaball>&
+MetaballSceneElement::metaballs() const {
+  return metaballs_;
+}
+
+void MetaballSceneElement::append(std::span<const Metaball> metaballs) {
+  if (metaballs.empty()) {
+    return;
+  }
+  const size_t start = metaballs_.size();
+  ScalarType max_radius = 0;
+  for (const auto& metaball : metaballs) {
+    UTIL_CHECK(metaball.radius > 0, "Invalid metaball radius (",
+               metaball.radius, ")");
+    max_radius = std::max(max_radius, metaball.radius);
+  }
+  metaballs_.insert(metaballs_.end(), metaballs.begin(), metaballs.end());
+  if (start == 0 || 2 * max_radius > grid_.cell_size()) {
+    rebuild_grid();
+    return;
+  }
+  for (size_t i = start; i < metaballs_.size(); ++i) {
+    const auto& metaball = metaballs_[i];
+    VectorType extent;
+    extent.fill(metaball.radius);
+    const auto lower = metaball.center - extent;
+    const auto upper = metaball.center + extent;
+    grid_.insert(i, lower, upper);
+    for (size_t d = 0; d < ndim; ++d) {
+      lower_[d] = std::min(lower_[d], lower[d]);
+      upper_[d] = std::max(upper_[d], upper[d]);
+    }
+  }
+}
+
+void MetaballSceneElement::truncate(size_t size) {
+  if (size >= metaballs_.size()) {
+    return;
+  }
+  for (size_t i = metaballs_.size(); i-- > size;) {
+    const auto& metaball = metaballs_[i];
+    VectorType extent;
+    extent.fill(metaball.radius);
+    grid_.remove_last(i, metaball.center - extent, metaball.center + extent);
+  }
+  metaballs_.resize(size);
+  update_bounds();
+}
+
+void MetaballSceneElement::rebuild_grid() {
+  // Note: Cells are as wide as the largest metaball, so each metaball
+  // overlaps at most 2^ndim cells.
+  ScalarType max_radius = 0;
+  for (const auto& metaball : metaballs_) {
+    max_radius = std::max(max_radius, metaball.radius);
+  }
+  grid_ = util::HashGrid<ndim, ScalarType>(max_radius > 0 ? 2 * max_radius
+                                                          : 1);
+  for (size_t i = 0; i < metaballs_.size(); ++i) {
+    const auto& metaball = metaballs_[i];
+    VectorType extent;
+    extent.fill(metaball.radius);
+    grid_.insert(i, metaball.center - extent, metaball.center + extent);
+  }
+  update_bounds();
+}
+
+void MetaballSceneElement::update_bounds() {
+  lower_.fill(std::numeric_limits<ScalarType>::infinity());
+  upper_.fill(-std::numeric_limits<ScalarType>::infinity());
+  for (const auto& metaball : metaballs_) {
+    for (size_t d = 0; d < ndim; ++d) {
+      lower_[d] = std::min(lower_[d], metaball.center[d] - metaball.radius);
+      upper_[d] = std::max(upper_[d], metaball.center[d] + metaball.radius);
+    }
+  }
+}
+
 }  // namespace metaball